@@ -0,0 +1,101 @@
+// Compile-time cost of constexpr shared_ptr operations.
+//
+// Evaluates one operation CE_N times in a static_assert. The operation is
+// chosen with -DCE_OP_<name>, where <name> is one of:
+//
+//   none                  include the headers only, as a baseline
+//   make_shared           CE_N calls to make_shared<int>
+//   copy                  CE_N copies of one shared_ptr
+//   weak_lock             CE_N calls to weak_ptr::lock
+//   dynamic_pointer_cast  CE_N downcasts through a polymorphic base
+//   atomic                CE_N store/load pairs on atomic<shared_ptr>
+//   array                 CE_N calls to make_shared<int[]>(8)
+//
+// All objects are held in a std::vector, not linked to each other, so that
+// destruction does not recurse and -fconstexpr-depth is never the limit.
+// ce_cost.sh compiles this file for each operation and size, and records the
+// compile time and the peak memory of the compiler.
+
+#include <memory>
+#include <atomic>
+#include <vector>
+
+#ifndef CE_N
+#define CE_N 1000
+#endif
+
+constexpr int n = CE_N;
+
+struct base
+{
+  constexpr virtual ~base() = default;
+  int i = 0;
+};
+
+struct derived : base
+{
+  int j = 1;
+};
+
+constexpr bool
+test()
+{
+  bool b = true;
+
+#if defined(CE_OP_none)
+  b = n > 0;
+#elif defined(CE_OP_make_shared)
+  std::vector<std::shared_ptr<int>> v;
+  v.reserve(n);
+  for (int i = 0; i < n; ++i)
+    v.push_back(std::make_shared<int>(i));
+  b = *v.back() == n - 1;
+#elif defined(CE_OP_copy)
+  auto p = std::make_shared<int>(42);
+  std::vector<std::shared_ptr<int>> v;
+  v.reserve(n);
+  for (int i = 0; i < n; ++i)
+    v.push_back(p);
+  b = p.use_count() == n + 1;
+#elif defined(CE_OP_weak_lock)
+  auto p = std::make_shared<int>(42);
+  std::weak_ptr<int> w = p;
+  int sum = 0;
+  for (int i = 0; i < n; ++i)
+    if (std::shared_ptr<int> q = w.lock())
+      sum += *q == 42;
+  b = sum == n;
+#elif defined(CE_OP_dynamic_pointer_cast)
+  std::shared_ptr<base> p = std::make_shared<derived>();
+  int sum = 0;
+  for (int i = 0; i < n; ++i)
+    if (auto q = std::dynamic_pointer_cast<derived>(p))
+      sum += q->j;
+  b = sum == n;
+#elif defined(CE_OP_atomic)
+  auto p = std::make_shared<int>(1);
+  auto q = std::make_shared<int>(2);
+  std::atomic<std::shared_ptr<int>> a{p};
+  int sum = 0;
+  for (int i = 0; i < n; ++i)
+    {
+      a.store(i % 2 ? p : q);
+      sum += *a.load();
+    }
+  b = sum == n / 2 * 3 + n % 2 * 2;
+#elif defined(CE_OP_array)
+  std::vector<std::shared_ptr<int[]>> v;
+  v.reserve(n);
+  for (int i = 0; i < n; ++i)
+    v.push_back(std::make_shared<int[]>(8));
+  b = v.back()[7] == 0;
+#else
+#error "define one of the CE_OP_<name> macros listed at the top of the file"
+#endif
+
+  return b;
+}
+
+static_assert(test());
+
+int main() { }
@@ -0,0 +1,55 @@
+#!/bin/bash
+
+# Compile-time cost of constexpr shared_ptr operations (see ce_cost.cpp).
+#
+# For each compiler, operation and size, prints the compile time in seconds
+# and the compiler's peak resident set size in kilobytes, both with the
+# baseline ("none") subtracted, and whether the evaluation also succeeds
+# within the compiler's default constexpr limits.
+#
+# Arguments, if given, replace the default sizes: ./ce_cost.sh 1000 5000
+
+MYINCLUDE="../include/c++/17.0.0"
+
+MYGCC="/opt/gcc-latest/bin/g++"
+MYGCC_LIMITS="-fconstexpr-ops-limit=1099511627776 -fconstexpr-loop-limit=1000000000"
+MYCLANG="clang++"
+MYCLANG_LIMITS="-fconstexpr-steps=2147483647"
+MYCLANG_NO_WARNINGS="-Wno-unknown-attributes -Wno-ignored-attributes -Wno-deprecated-builtins -Wno-keyword-compat -Wno-inconsistent-missing-override -Wno-user-defined-literals -Wno-unknown-warning-option -Wno-inline-namespace-reopened-noninline -Wno-implicit-exception-spec-mismatch -Wno-gnu-inline-cpp-without-extern -Wno-vla-cxx-extension -Wno-unqualified-std-cast-call"
+FLAGS="-fsyntax-only -std=c++26 -I ${MYINCLUDE} -I ${MYINCLUDE}/x86_64-pc-linux-gnu"
+
+OPS="make_shared copy weak_lock dynamic_pointer_cast atomic array"
+SIZES="${*:-1000 10000 100000}"
+
+TIMES=$(mktemp)
+trap 'rm -f "${TIMES}"' EXIT
+
+# Prints "seconds kilobytes" for one compile, or "fail fail".
+# $1 compiler and options, $2 operation, $3 size
+measure() {
+  /usr/bin/time -o "${TIMES}" -f "%e %M" $1 ${FLAGS} -DCE_OP_$2 -DCE_N=$3 \
+    ce_cost.cpp > /dev/null 2>&1 && tail -n 1 "${TIMES}" || echo "fail fail"
+}
+
+# $1 name, $2 compiler and options, $3 options raising the limits
+run() {
+  echo -e "\n        **** << constexpr evaluation cost ($1) >> ****\n"
+  read base_s base_kb <<< "$(measure "$2 $3" none 1)"
+  printf "%-22s %8s %10s %10s %s\n" op N seconds "RSS (kB)" "default limits"
+  for op in ${OPS}; do
+    for n in ${SIZES}; do
+      read s kb <<< "$(measure "$2 $3" ${op} ${n})"
+      if [ "$s" = fail ]; then
+	printf "%-22s %8d %10s %10s\n" ${op} ${n} failed failed
+	continue
+      fi
+      $2 ${FLAGS} -DCE_OP_${op} -DCE_N=${n} ce_cost.cpp 2>/dev/null \
+	&& fits=ok || fits=exceeded
+      printf "%-22s %8d %10.2f %10d %s\n" ${op} ${n} \
+	$(awk "BEGIN { print $s - $base_s }") $((kb - base_kb)) ${fits}
+    done
+  done
+}
+
+run GCC "${MYGCC}" "${MYGCC_LIMITS}"
+run Clang "${MYCLANG} ${MYCLANG_NO_WARNINGS}" "${MYCLANG_LIMITS}"
@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# Builds sp_microbench.cpp against the headers in this repository and against
+# the compiler's own libstdc++ headers ("master"), with GCC and Clang, and
+# prints the change in time per operation.
+#
+#   MASTER_INCLUDE  the unmodified headers (default: those of /opt/gcc-latest)
+#   MAX_SLOWDOWN    percentage above which a result is flagged (default: 5);
+#                   the script exits with status 1 if any result is flagged.
+#
+# Arguments are passed on to sp_microbench: iterations, threads, repetitions.
+
+MYINCLUDE="../include/c++/17.0.0"
+MASTER_INCLUDE="${MASTER_INCLUDE:-/opt/gcc-latest/include/c++/17.0.0}"
+MAX_SLOWDOWN="${MAX_SLOWDOWN:-5}"
+
+MYGCC="/opt/gcc-latest/bin/g++ -Wl,-rpath,"/opt/gcc-latest/lib64:$LD_LIBRARY_PATH""
+MYCLANG="clang++ -Wl,-rpath,"/opt/gcc-latest/lib64:$LD_LIBRARY_PATH" -L /opt/gcc-latest/lib64"
+MYCLANG_NO_WARNINGS="-Wno-unknown-attributes -Wno-ignored-attributes -Wno-deprecated-builtins -Wno-keyword-compat -Wno-inconsistent-missing-override -Wno-user-defined-literals -Wno-unknown-warning-option -Wno-inline-namespace-reopened-noninline -Wno-implicit-exception-spec-mismatch -Wno-gnu-inline-cpp-without-extern -Wno-vla-cxx-extension -Wno-unqualified-std-cast-call"
+FLAGS="-O2 -DNDEBUG -std=c++26 -pthread -nostdinc++"
+
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+status=0
+
+# $1 compiler, $2 include directory, $3 output file
+build_and_run() {
+  $1 ${FLAGS} -I "$2" -I "$2/x86_64-pc-linux-gnu" sp_microbench.cpp \
+     -o "$OUT/a.out" && "$OUT/a.out" "${@:4}" > "$3"
+}
+
+# $1 master results, $2 constexpr results
+compare() {
+  awk -F'\t' -v max="${MAX_SLOWDOWN}" '
+    NR == FNR { m[$1] = $2; next }
+    ($1 in m) {
+      d = m[$1] > 0 ? 100 * ($2 - m[$1]) / m[$1] : 0
+      flag = d > max ? "  << slower" : ""
+      if (flag != "") bad = 1
+      printf "%-24s %10.2f %10.2f %+8.1f%%%s\n", $1, m[$1], $2, d, flag
+    }
+    END { exit bad }' "$1" "$2"
+}
+
+# $1 name, $2 compiler
+run() {
+  echo -e "\n        **** << master vs constexpr headers ($1) >> ****\n"
+  build_and_run "$2" "${MASTER_INCLUDE}" "$OUT/master" "${@:3}" || { status=1; return; }
+  build_and_run "$2" "${MYINCLUDE}" "$OUT/constexpr" "${@:3}" || { status=1; return; }
+  printf "%-24s %10s %10s %9s\n" "ns/op" "master" "constexpr" "change"
+  compare "$OUT/master" "$OUT/constexpr" || status=1
+}
+
+run GCC "${MYGCC}" "$@"
+run Clang "${MYCLANG} ${MYCLANG_NO_WARNINGS}" "$@"
+
+exit $status
@@ -0,0 +1,80 @@
+// Probe lengths of std::owner_hash in a power-of-two open-addressing table.
+//
+// "identity" is what owner_hash used to be, std::hash of a pointer, taken
+// here on the object address (for make_shared the object sits at a fixed
+// offset in the control block, so it has the same low-bit structure).
+// "owner_hash" is the current std::owner_hash. Both are inserted into a
+// linear-probing table masked with capacity-1, the layout used by most
+// flat hash maps, and the mean and worst probe lengths are reported.
+
+#include <memory>
+#include <vector>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+
+struct probe_stats
+{
+  double mean;
+  std::size_t max;
+};
+
+probe_stats
+probe(const std::vector<std::size_t>& hashes, std::size_t capacity)
+{
+  std::vector<bool> used(capacity);
+  std::size_t total = 0, worst = 0;
+  for (std::size_t h : hashes)
+    {
+      std::size_t i = h & (capacity - 1), n = 1;
+      while (used[i])
+	{
+	  i = (i + 1) & (capacity - 1);
+	  ++n;
+	}
+      used[i] = true;
+      total += n;
+      worst = std::max(worst, n);
+    }
+  return { double(total) / hashes.size(), worst };
+}
+
+template<typename T>
+void
+run(const char* name, std::size_t n)
+{
+  std::vector<std::shared_ptr<T>> owners;
+  owners.reserve(n);
+  for (std::size_t i = 0; i < n; ++i)
+    owners.push_back(std::make_shared<T>());
+
+  std::size_t capacity = 1;
+  while (capacity < 2 * n) // load factor <= 0.5
+    capacity *= 2;
+
+  std::vector<std::size_t> identity, mixed;
+  for (auto& p : owners)
+    {
+      identity.push_back(std::hash<T*>()(p.get()));
+      mixed.push_back(std::owner_hash()(p));
+    }
+
+  probe_stats before = probe(identity, capacity);
+  probe_stats after = probe(mixed, capacity);
+  std::printf("%s/%zu\tidentity mean %.2f max %zu\towner_hash mean %.2f max %zu\n",
+	      name, n, before.mean, before.max, after.mean, after.max);
+}
+
+struct small { int i; };
+struct medium { char buf[40]; };
+struct large { char buf[4000]; };
+
+int main(int argc, char* argv[])
+{
+  std::size_t n = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100'000;
+  run<small>("small", n);
+  run<medium>("medium", n);
+  run<large>("large", n);
+}
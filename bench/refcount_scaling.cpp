@@ -0,0 +1,177 @@
+// Scaling of reference counting when many threads share one control block,
+// as when a shared immutable table is handed out to every worker.
+//
+// For each lock policy, every thread repeatedly copies the same pointer and
+// destroys the copy ("copy"), or promotes a weak_ptr to it ("lock"). Reports,
+// per policy, pattern and thread count:
+//
+//   ops/s      operations per second, over all threads
+//   p99 ns     99th percentile of the time per operation, measured over
+//              batches of operations so as not to be dominated by the clock
+//   misses/op  hardware cache misses per operation, from perf_event_open,
+//              where it is available and permitted (otherwise "-")
+//
+// _S_single is only run on one thread. To measure a new policy, add it to
+// main(). The thread counts are powers of two up to the first argument
+// (default 128); the second argument is the number of operations per thread.
+
+#include <memory>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#if __has_include(<linux/perf_event.h>)
+# include <linux/perf_event.h>
+# include <sys/syscall.h>
+# include <sys/ioctl.h>
+# include <unistd.h>
+# define HAVE_PERF_EVENT 1
+#endif
+
+// Counts cache misses in this thread and in threads it creates afterwards.
+struct cache_miss_counter
+{
+  cache_miss_counter()
+  {
+#ifdef HAVE_PERF_EVENT
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd != -1)
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+  }
+
+  ~cache_miss_counter()
+  {
+#ifdef HAVE_PERF_EVENT
+    if (fd != -1)
+      close(fd);
+#endif
+  }
+
+  // The count so far, or -1 if it is not available.
+  long long
+  read() const
+  {
+#ifdef HAVE_PERF_EVENT
+    long long n;
+    if (fd != -1 && ::read(fd, &n, sizeof n) == sizeof n)
+      return n;
+#endif
+    return -1;
+  }
+
+  int fd = -1;
+};
+
+template<typename T>
+inline void
+escape(const T* p)
+{ asm volatile("" : : "r"(p) : "memory"); }
+
+struct table { int data[64] = {}; };
+
+constexpr long batch = 64;
+
+template<typename F>
+void
+run(const char* name, unsigned nthreads, long iters, F f)
+{
+  long batches = std::max(1L, iters / batch);
+  std::vector<std::vector<float>> times(nthreads);
+  std::atomic<unsigned> ready{0};
+  std::atomic<bool> go{false};
+
+  cache_miss_counter misses; // Before the threads, so that they inherit it.
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < nthreads; ++t)
+    pool.emplace_back([&, t] {
+      auto& tt = times[t];
+      tt.reserve(batches);
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire))
+	;
+      for (long i = 0; i < batches; ++i)
+	{
+	  auto start = std::chrono::steady_clock::now();
+	  for (long j = 0; j < batch; ++j)
+	    f();
+	  std::chrono::duration<float, std::nano> d
+	    = std::chrono::steady_clock::now() - start;
+	  tt.push_back(d.count() / batch);
+	}
+    });
+  while (ready.load() != nthreads)
+    ;
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& th : pool)
+    th.join();
+  std::chrono::duration<double> elapsed
+    = std::chrono::steady_clock::now() - start;
+  long long nmisses = misses.read();
+
+  std::vector<float> all;
+  for (auto& tt : times)
+    all.insert(all.end(), tt.begin(), tt.end());
+  auto p99 = all.begin() + (all.size() - 1) * 99 / 100;
+  std::nth_element(all.begin(), p99, all.end());
+
+  double ops = double(batches) * batch * nthreads;
+  std::printf("%-24s %4u %14.0f %10.1f ", name, nthreads,
+	      ops / elapsed.count(), *p99);
+  if (nmisses < 0)
+    std::printf("%10s\n", "-");
+  else
+    std::printf("%10.3f\n", nmisses / ops);
+}
+
+template<__gnu_cxx::_Lock_policy Lp>
+void
+run_policy(const char* policy, unsigned max_threads, long iters)
+{
+  auto sp = std::__make_shared<table, Lp>();
+  std::__weak_ptr<table, Lp> wp = sp;
+  char copy[64], lock[64];
+  std::snprintf(copy, sizeof copy, "%s/copy", policy);
+  std::snprintf(lock, sizeof lock, "%s/lock", policy);
+
+  if (Lp == __gnu_cxx::_S_single)
+    max_threads = 1;
+  for (unsigned n = 1; n <= max_threads; n *= 2)
+    {
+      run(copy, n, iters, [&] {
+	std::__shared_ptr<table, Lp> p = sp;
+	escape(p.get());
+      });
+      run(lock, n, iters, [&] {
+	std::__shared_ptr<table, Lp> p = wp.lock();
+	escape(p.get());
+      });
+    }
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned max_threads = argc > 1 ? std::atoi(argv[1]) : 128;
+  long iters = argc > 2 ? std::atol(argv[2]) : 1'000'000;
+
+  std::printf("%-24s %4s %14s %10s %10s\n",
+	      "policy/pattern", "thr", "ops/s", "p99 ns", "misses/op");
+  run_policy<__gnu_cxx::_S_single>("single", max_threads, iters);
+  run_policy<__gnu_cxx::_S_mutex>("mutex", max_threads, iters);
+  run_policy<__gnu_cxx::_S_atomic>("atomic", max_threads, iters);
+}
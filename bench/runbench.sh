@@ -0,0 +1,18 @@
+#!/bin/bash
+
+MYINCLUDE="../include/c++/17.0.0"
+
+MYGCC="/opt/gcc-latest/bin/g++ -Wl,-rpath,"/opt/gcc-latest/lib64:$LD_LIBRARY_PATH""
+MYGCC_FLAGS="-O2 -DNDEBUG -std=c++26 -pthread -I ${MYINCLUDE} -I ${MYINCLUDE}/x86_64-pc-linux-gnu"
+
+echo -e "\n        **** << weak_ptr::lock() contention: CAS loop (GCC) >> ****\n"
+${MYGCC} ${MYGCC_FLAGS} weak_lock_contention.cpp && ./a.out "$@"
+
+echo -e "\n        **** << weak_ptr::lock() contention: fetch_add (GCC) >> ****\n"
+${MYGCC} ${MYGCC_FLAGS} -D_GLIBCXX_SP_FETCH_ADD_LOCK weak_lock_contention.cpp && ./a.out "$@"
+
+echo -e "\n        **** << owner_hash probe lengths (GCC) >> ****\n"
+${MYGCC} ${MYGCC_FLAGS} owner_hash_probe.cpp && ./a.out
+
+echo -e "\n        **** << reference count scaling by lock policy (GCC) >> ****\n"
+${MYGCC} ${MYGCC_FLAGS} refcount_scaling.cpp && ./a.out
@@ -0,0 +1,158 @@
+// Runtime microbenchmarks for shared_ptr, weak_ptr, atomic<shared_ptr> and
+// out_ptr.
+//
+// compare_master.sh builds this file twice, once against the headers in this
+// repository and once against the compiler's own (unmodified) libstdc++
+// headers, and reports the difference, to show whether making them constexpr
+// cost anything at run time.
+//
+// Each line of output is "name/threads<TAB>nanoseconds per operation", the
+// best of several repetitions. Multi-threaded variants all work on the same
+// object, so they measure contended reference counting.
+
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+template<typename T>
+inline void
+escape(const T* p)
+{ asm volatile("" : : "r"(p) : "memory"); }
+
+// Mean time per call of f(), in nanoseconds, as seen by each thread.
+template<typename F>
+double
+run_once(unsigned nthreads, long iters, F& f)
+{
+  std::atomic<unsigned> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < nthreads; ++t)
+    pool.emplace_back([&] {
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire))
+	;
+      for (long i = 0; i < iters; ++i)
+	f();
+    });
+  while (ready.load() != nthreads)
+    ;
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& th : pool)
+    th.join();
+  std::chrono::duration<double, std::nano> d
+    = std::chrono::steady_clock::now() - start;
+  return d.count() / iters;
+}
+
+int reps = 5;
+
+template<typename F>
+void
+bench(const char* name, unsigned nthreads, long iters, F f)
+{
+  double best = run_once(nthreads, iters, f);
+  for (int r = 1; r < reps; ++r)
+    best = std::min(best, run_once(nthreads, iters, f));
+  std::printf("%s/%u\t%.2f\n", name, nthreads, best);
+}
+
+// Stands in for a C API that returns a new object through an out parameter.
+[[gnu::noinline]] void
+c_api_create(int** pp)
+{ *pp = new int(42); }
+
+void
+run_all(unsigned nthreads, long iters)
+{
+  auto sp = std::make_shared<int>(42);
+  std::weak_ptr<int> wp = sp;
+  std::atomic<std::shared_ptr<int>> asp{sp};
+  auto other = std::make_shared<int>(43);
+
+  bench("copy", nthreads, iters, [&] {
+    std::shared_ptr<int> p = sp;
+    escape(&p);
+  });
+
+  bench("move", nthreads, iters, [&] {
+    // Each thread moves its own pointer back and forth.
+    thread_local std::shared_ptr<int> a = sp, b;
+    b = std::move(a);
+    escape(&b);
+    a = std::move(b);
+    escape(&a);
+  });
+
+  bench("make_shared", nthreads, iters, [&] {
+    auto p = std::make_shared<int>(1);
+    escape(p.get());
+  });
+
+  bench("weak_lock", nthreads, iters, [&] {
+    std::shared_ptr<int> p = wp.lock();
+    escape(p.get());
+  });
+
+  bench("atomic_load", nthreads, iters, [&] {
+    std::shared_ptr<int> p = asp.load();
+    escape(p.get());
+  });
+
+  bench("atomic_store", nthreads, iters, [&] {
+    thread_local bool flip = false;
+    asp.store((flip = !flip) ? other : sp);
+  });
+
+  bench("out_ptr", nthreads, iters, [&] {
+    std::shared_ptr<int> p;
+    c_api_create(std::out_ptr(p, std::default_delete<int>()));
+    escape(p.get());
+  });
+}
+
+// Destroying the last owner, including the deleter and deallocation.
+// Timed in batches, since the owners have to be created first.
+void
+run_destroy(long iters)
+{
+  constexpr long batch = 1000;
+  std::vector<std::shared_ptr<int>> v;
+  v.reserve(batch);
+  double best = 0;
+  for (int r = 0; r < reps; ++r)
+    {
+      std::chrono::duration<double, std::nano> total{};
+      for (long done = 0; done < iters; done += batch)
+	{
+	  for (long i = 0; i < batch; ++i)
+	    v.push_back(std::make_shared<int>(i));
+	  auto start = std::chrono::steady_clock::now();
+	  v.clear();
+	  total += std::chrono::steady_clock::now() - start;
+	}
+      double ns = total.count() / iters;
+      best = r == 0 ? ns : std::min(best, ns);
+    }
+  std::printf("destroy/1\t%.2f\n", best);
+}
+
+int main(int argc, char* argv[])
+{
+  long iters = argc > 1 ? std::atol(argv[1]) : 1'000'000;
+  unsigned nthreads = argc > 2 ? std::atoi(argv[2])
+				: std::thread::hardware_concurrency();
+  if (argc > 3)
+    reps = std::max(1, std::atoi(argv[3]));
+
+  run_all(1, iters);
+  if (nthreads > 1)
+    run_all(nthreads, iters / nthreads);
+  run_destroy(iters);
+}
@@ -0,0 +1,82 @@
+// Contended weak_ptr::lock() and enable_shared_from_this::shared_from_this().
+//
+// Every thread repeatedly promotes the same control block to a shared owner
+// and drops it again. Build with and without -D_GLIBCXX_SP_FETCH_ADD_LOCK to
+// compare the compare-and-swap loop in _M_add_ref_lock_nothrow() with the
+// fetch_add scheme (see runbench.sh).
+
+#include <memory>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+struct node : std::enable_shared_from_this<node>
+{
+  int value = 42;
+};
+
+template<typename T>
+inline void
+escape(const T* p)
+{ asm volatile("" : : "r"(p) : "memory"); }
+
+// Returns the mean time per operation in nanoseconds, as seen by each thread.
+template<typename F>
+double
+run(unsigned nthreads, long iters, F f)
+{
+  std::atomic<unsigned> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < nthreads; ++t)
+    pool.emplace_back([&] {
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire))
+	;
+      for (long i = 0; i < iters; ++i)
+	f();
+    });
+  while (ready.load() != nthreads)
+    ;
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& th : pool)
+    th.join();
+  std::chrono::duration<double, std::nano> d
+    = std::chrono::steady_clock::now() - start;
+  return d.count() / iters;
+}
+
+int main(int argc, char* argv[])
+{
+  long iters = argc > 1 ? std::atol(argv[1]) : 1'000'000;
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  auto sp = std::make_shared<node>();
+  std::weak_ptr<node> wp = sp;
+  node* raw = sp.get();
+
+#ifdef _GLIBCXX_SP_FETCH_ADD_LOCK
+  const char* scheme = "fetch_add";
+#else
+  const char* scheme = "cas";
+#endif
+
+  for (unsigned n = 1; n <= max_threads; n *= 2)
+    {
+      double lock_ns = run(n, iters, [&] {
+	std::shared_ptr<node> p = wp.lock();
+	escape(p.get());
+      });
+      double esft_ns = run(n, iters, [&] {
+	std::shared_ptr<node> p = raw->shared_from_this();
+	escape(p.get());
+      });
+      std::printf("weak_lock/%s/%u\t%.2f\n", scheme, n, lock_ns);
+      std::printf("shared_from_this/%s/%u\t%.2f\n", scheme, n, esft_ns);
+    }
+}
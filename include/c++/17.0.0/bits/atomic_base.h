@@ -115,12 +115,19 @@ bool ce__atomic_test_and_set(auto *ptr, int memorder)
   if consteval { auto tmp = *ptr; *ptr = 1; return tmp; }
   else         { return __atomic_test_and_set(ptr, memorder); }
 }
+// Constant evaluation is single-threaded, so a wait there for a value to
+// change would never return. Calling this instead makes the wait an error
+// straight away, naming the problem, rather than a loop that runs until
+// the compiler's evaluation limits are hit. Never called at run time.
+[[__noreturn__]] inline void
+ce__atomic_wait_would_block_forever() noexcept
+{ __builtin_trap(); }
 template<typename _Tp, typename _ValFn>
 _GLIBCXX26_CONSTEXPR
 void
 ce__atomic_wait_address_v(const _Tp* __addr, _Tp __old, _ValFn __vfn) noexcept
 {
-  if consteval { if (*__addr == __old) { while(true); } } // infinite loop
+  if consteval { if (*__addr == __old) ce__atomic_wait_would_block_forever(); }
   else         { std::__atomic_wait_address_v(__addr, __old, __vfn); }
 }
 template<typename _Tp>
@@ -45,6 +45,16 @@
 #include <tuple>
 #include <bits/ptr_traits.h>
 
+#if _GLIBCXX_HOSTED
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+  template<typename _Tp, typename _Del, typename _Alloc = std::allocator<void>>
+    class out_ptr_block;
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+#endif
+
 namespace std _GLIBCXX_VISIBILITY(default)
 {
 _GLIBCXX_BEGIN_NAMESPACE_VERSION
@@ -400,6 +410,96 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	{
 	  using _Impl<_Smart, _Pointer, _Del, allocator<void>>::_Impl;
 	};
+
+      // Partial specialization for std::shared_ptr, taking the control
+      // block from a __gnu_cxx::out_ptr_block instead of allocating it.
+      template<typename _Tp, typename _Del,
+	       typename _BTp, typename _BDel, typename _BAlloc>
+	requires (is_base_of_v<__shared_ptr<_Tp>, shared_ptr<_Tp>>)
+	struct _Impl<shared_ptr<_Tp>,
+		     typename shared_ptr<_Tp>::element_type*, _Del,
+		     __gnu_cxx::out_ptr_block<_BTp, _BDel, _BAlloc>&>
+	{
+	  using _Block = __gnu_cxx::out_ptr_block<_BTp, _BDel, _BAlloc>;
+	  using _Sp = typename _Smart::element_type*;
+	  using _Scd = typename _Block::_Scd;
+
+	  static_assert(is_same_v<_Sp, typename _Block::_Sp>
+			  && is_same_v<decay_t<_Del>, _BDel>,
+			"out_ptr_block must have the same element type and "
+			"deleter as the std::out_ptr call it is used with");
+
+	  _GLIBCXX26_CONSTEXPR
+	  _Impl(_Smart& __s, _Del __d, _Block& __b)
+	  : _M_smart(__s), _M_block(__b)
+	  {
+	    auto& __pi = _M_smart._M_refcount._M_pi;
+	    if (!__b._M_mem && __b._M_can_recycle(__pi))
+	      {
+		// __s is the only reference to a block of the type we need,
+		// so run its deleter and keep the memory, rather than
+		// freeing it in reset() and allocating it again below.
+		auto __old = static_cast<_Scd*>(std::__exchange(__pi, nullptr));
+		_M_smart._M_ptr = nullptr;
+#ifdef _GLIBCXX_SP_INSTRUMENT
+		__old->_M_notify(_Sp_event::_S_dispose);
+#endif
+		__old->_M_dispose();
+		__old->~_Scd();
+		__b._M_mem = __old;
+	      }
+	    else
+	      _M_smart.reset();
+
+	    _Scd* __mem = __b._M_take();
+	    ::new (__mem) _Scd(nullptr, std::forward<_Del>(__d), __b._M_alloc);
+	    __pi = __mem;
+
+#ifdef __abi_break_for_conv_ops
+      _M_pv     = _M_smart._M_ptr;
+      _M_p_orig = _M_smart._M_ptr;
+#endif
+	  }
+
+	  _GLIBCXX26_CONSTEXPR
+	  _Pointer*
+	  _M_get() const noexcept
+	  { return __builtin_addressof(_M_smart._M_ptr); }
+
+#ifdef __abi_break_for_conv_ops
+	  _GLIBCXX26_CONSTEXPR
+	  void**
+	  _M_getv() const
+	  { return __builtin_addressof(const_cast<void*&>(_M_pv)); }
+#endif
+
+	  _GLIBCXX26_CONSTEXPR
+	  ~_Impl()
+	  {
+#ifdef __abi_break_for_conv_ops
+      if (_M_pv != _M_p_orig)
+        _M_smart._M_ptr = static_cast<_Smart::element_type*>(_M_pv);
+#endif
+
+	    auto& __pi = _M_smart._M_refcount._M_pi;
+
+	    if (_Sp __ptr = _M_smart.get())
+	      static_cast<_Scd*>(__pi)->_M_ptr = __ptr;
+	    else // Give the memory back to the block for next time.
+	      {
+		auto __mem = static_cast<_Scd*>(std::__exchange(__pi, nullptr));
+		__mem->~_Scd();
+		_M_block._M_mem = __mem;
+	      }
+	  }
+
+	  _Smart& _M_smart;
+	  _Block& _M_block;
+#ifdef __abi_break_for_conv_ops
+	  void* _M_pv;
+	  void* _M_p_orig;
+#endif
+	};
 #endif
 
       using _Impl_t = _Impl<_Smart, _Pointer, _Args...>;
@@ -601,5 +701,117 @@ namespace __detail
 _GLIBCXX_END_NAMESPACE_VERSION
 } // namespace
 
+#if _GLIBCXX_HOSTED
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  /**
+   *  @brief  A reusable control block for `std::out_ptr` with `shared_ptr`.
+   *
+   *  `std::out_ptr(__sp, __d)` allocates a control block before the output
+   *  pointer is written, so that nothing can fail afterwards, and frees it
+   *  again if no pointer comes back. Passing an `out_ptr_block` as well,
+   *  `std::out_ptr(__sp, __d, __blk)`, takes the control block from
+   *  `__blk` instead, and puts it back there if no pointer comes back.
+   *  When `__sp` is the only reference to a control block of the same
+   *  type (this needs RTTI and an always-equal allocator), that block is
+   *  reused rather than freed by the reset. A loop that refills one
+   *  `shared_ptr` from a C API this way allocates only on its first pass.
+   *
+   *  @tparam _Tp    The `shared_ptr` template argument.
+   *  @tparam _Del   The deleter type passed to `std::out_ptr`.
+   *  @tparam _Alloc The allocator for the control block.
+   */
+  template<typename _Tp, typename _Del, typename _Alloc>
+    class out_ptr_block
+    {
+    public:
+      typedef _Alloc allocator_type;
+
+      out_ptr_block() = default;
+
+      _GLIBCXX26_CONSTEXPR
+      explicit
+      out_ptr_block(const _Alloc& __a) noexcept
+      : _M_alloc(__a)
+      { }
+
+      out_ptr_block(const out_ptr_block&) = delete;
+      out_ptr_block& operator=(const out_ptr_block&) = delete;
+
+      _GLIBCXX26_CONSTEXPR
+      ~out_ptr_block()
+      { release(); }
+
+      /// Allocate the control block now, unless one is already held.
+      _GLIBCXX26_CONSTEXPR
+      void
+      reserve()
+      {
+	if (!_M_mem)
+	  _M_mem = _M_take();
+      }
+
+      /// Free the control block, if one is held.
+      _GLIBCXX26_CONSTEXPR
+      void
+      release() noexcept
+      {
+	if (_M_mem)
+	  {
+	    typename _Scd::__allocator_type __a(_M_alloc);
+	    __a.deallocate(std::__exchange(_M_mem, nullptr), 1);
+	  }
+      }
+
+      /// True if the next `std::out_ptr` call will not allocate.
+      _GLIBCXX26_CONSTEXPR
+      bool
+      has_block() const noexcept
+      { return _M_mem != nullptr; }
+
+      allocator_type
+      get_allocator() const noexcept
+      { return _M_alloc; }
+
+    private:
+      template<typename, typename, typename...> friend class std::out_ptr_t;
+
+      using _Sp = typename std::shared_ptr<_Tp>::element_type*;
+      using _Scd = std::_Sp_counted_deleter<_Sp, _Del, _Alloc,
+					    __default_lock_policy>;
+
+      // The held memory, or a newly allocated block.
+      _GLIBCXX26_CONSTEXPR
+      _Scd*
+      _M_take()
+      {
+	if (_M_mem)
+	  return std::__exchange(_M_mem, nullptr);
+	typename _Scd::__allocator_type __a(_M_alloc);
+	return __a.allocate(1);
+      }
+
+      // Whether the memory of *__pi can be taken over for a new _Scd.
+      _GLIBCXX26_CONSTEXPR
+      static bool
+      _M_can_recycle(std::_Sp_counted_base<>* __pi) noexcept
+      {
+#if __cpp_rtti
+	if constexpr (std::allocator_traits<_Alloc>::is_always_equal::value)
+	  return __pi && __pi->_M_sole_owner() && typeid(*__pi) == typeid(_Scd);
+#endif
+	return false;
+      }
+
+      _Scd* _M_mem = nullptr;
+      [[__no_unique_address__]] _Alloc _M_alloc = _Alloc();
+    };
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+#endif // HOSTED
+
 #endif // __glibcxx_out_ptr
 #endif /* _GLIBCXX_OUT_PTR_H */
@@ -966,11 +966,13 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
   struct owner_hash
   {
     template<typename _Tp>
+      _GLIBCXX26_CONSTEXPR
       size_t
       operator()(const shared_ptr<_Tp>& __s) const noexcept
       { return __s.owner_hash(); }
 
     template<typename _Tp>
+      _GLIBCXX26_CONSTEXPR
       size_t
       operator()(const weak_ptr<_Tp>& __s) const noexcept
       { return __s.owner_hash(); }
@@ -987,24 +989,28 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
   struct owner_equal
   {
     template<typename _Tp1, typename _Tp2>
+      _GLIBCXX26_CONSTEXPR
       bool
       operator()(const shared_ptr<_Tp1>& __lhs,
 		 const shared_ptr<_Tp2>& __rhs) const noexcept
       { return __lhs.owner_equal(__rhs); }
 
     template<typename _Tp1, typename _Tp2>
+      _GLIBCXX26_CONSTEXPR
       bool
       operator()(const shared_ptr<_Tp1>& __lhs,
 		 const   weak_ptr<_Tp2>& __rhs) const noexcept
       { return __lhs.owner_equal(__rhs); }
 
     template<typename _Tp1, typename _Tp2>
+      _GLIBCXX26_CONSTEXPR
       bool
       operator()(const   weak_ptr<_Tp1>& __lhs,
 		 const shared_ptr<_Tp2>& __rhs) const noexcept
       { return __lhs.owner_equal(__rhs); }
 
     template<typename _Tp1, typename _Tp2>
+      _GLIBCXX26_CONSTEXPR
       bool
       operator()(const weak_ptr<_Tp1>& __lhs,
 		 const weak_ptr<_Tp2>& __rhs)   const noexcept
@@ -1065,11 +1071,13 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 #endif
 
     private:
+      // Only called by the constructors of __shared_ptr that create a new
+      // control block, so no other thread can see __n yet.
       template<typename _Tp1>
 	_GLIBCXX26_CONSTEXPR
 	void
 	_M_weak_assign(_Tp1* __p, const __shared_count<>& __n) const noexcept
-	{ _M_weak_this._M_assign(__p, __n); }
+	{ _M_weak_this._M_assign_unshared(__p, __n); }
 
       // Found by ADL when this is an associated class.
       _GLIBCXX26_CONSTEXPR
@@ -1081,6 +1089,8 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       template<typename, _Lock_policy>
 	friend class __shared_ptr;
 
+      friend struct _Sp_block_access;
+
       mutable weak_ptr<_Tp>  _M_weak_this;
     };
 
@@ -1192,10 +1202,33 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       using _Up = remove_all_extents_t<_Tp>;
       using _UpAlloc = __alloc_rebind<_Alloc, _Up>;
       size_t __s = sizeof(remove_extent_t<_Tp>) / sizeof(_Up);
-      if (__builtin_mul_overflow(__s, __n, &__n))
+      if (__builtin_mul_overflow(__s, __n, &__n)
+	    || (__n & _Sp_counted_array_base<_UpAlloc>::_S_overwrite_bit))
 	std::__throw_bad_array_new_length();
       return _Sp_counted_array_base<_UpAlloc>{_UpAlloc(__a), __n};
     }
+
+#ifdef _GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD
+  // Whether make_shared<_Tp> of __n elements, value-initialized, should
+  // take its memory from calloc instead of zeroing it.
+  template<typename _Tp>
+    constexpr bool
+    __sp_zeroed_array(size_t __n) noexcept
+    {
+      using _Up = remove_all_extents_t<_Tp>;
+      // Null pointers to data members are not all zero bits.
+      if constexpr (is_scalar_v<_Up> && !is_member_pointer_v<_Up>)
+	{
+	  // Too many bytes to count is certainly large.
+	  size_t __bytes;
+	  return __builtin_mul_overflow(__n, sizeof(remove_extent_t<_Tp>),
+					&__bytes)
+	    || __bytes >= size_t(_GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD);
+	}
+      else
+	return false;
+    }
+#endif
   /// @endcond
 
   template<typename _Tp, typename _Alloc>
@@ -1224,6 +1257,12 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
         return cest_allocate_shared<_Tp>(allocator<_Tp>{}, __n);
       }
       else
+#endif
+#ifdef _GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD
+      if (std::__sp_zeroed_array<_Tp>(__n))
+	return shared_ptr<_Tp>(std::__make_shared_arr_tag<_Tp>(
+				 __n, __sp_zeroed_allocator<void>()));
+      else
 #endif
       return shared_ptr<_Tp>(std::__make_shared_arr_tag<_Tp>(__n));
     }
@@ -1299,6 +1338,12 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
         return cest_allocate_shared<_Tp>(allocator<_Tp>{}, extent_v<_Tp>);
       }
       else
+#endif
+#ifdef _GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD
+      if constexpr (std::__sp_zeroed_array<_Tp>(extent_v<_Tp>))
+	return shared_ptr<_Tp>(std::__make_shared_arrN_tag<_Tp>(
+				 __sp_zeroed_allocator<void>()));
+      else
 #endif
       return shared_ptr<_Tp>(std::__make_shared_arrN_tag<_Tp>());
     }
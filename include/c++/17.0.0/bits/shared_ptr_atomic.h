@@ -531,29 +531,17 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	    return;
 	  }
 #endif
-#if __glibcxx_constexpr_memory >= 202506L
 	  _GLIBCXX_TSAN_MUTEX_PRE_UNLOCK(&_M_val);
-	  auto __current = _M_val.load(memory_order_relaxed);
-	  _GLIBCXX_TSAN_MUTEX_TRY_LOCK(&_M_val);
-
-	  while (!_M_val.compare_exchange_strong(__current,
-						 reinterpret_cast<pointer>(reinterpret_cast<uintptr_t>(__current) & ~_S_lock_bit),
-						 __o,
-						 memory_order_relaxed))
-	    {
-	      _GLIBCXX_TSAN_MUTEX_TRY_LOCK_FAILED(&_M_val);
-#if __glibcxx_atomic_wait
-	      __detail::__thread_relax();
-#endif
-	      __current = reinterpret_cast<pointer>(reinterpret_cast<uintptr_t>(__current) | _S_lock_bit);
-	      _GLIBCXX_TSAN_MUTEX_TRY_LOCK(&_M_val);
-	    }
-	  _GLIBCXX_TSAN_MUTEX_LOCKED(&_M_val);
+#if __glibcxx_constexpr_memory >= 202506L
+	  // The lock bit is set, so subtracting one clears it. Unlike
+	  // fetch_sub, the built-in does not scale by the size of the
+	  // pointee. _M_val is standard-layout, so has the address of its
+	  // pointer member.
+	  __atomic_fetch_sub(reinterpret_cast<pointer*>(&_M_val), 1, int(__o));
 #else
-	  _GLIBCXX_TSAN_MUTEX_PRE_UNLOCK(&_M_val);
 	  _AtomicRef(&_M_val).fetch_sub(1, __o);
-	  _GLIBCXX_TSAN_MUTEX_POST_UNLOCK(&_M_val);
 #endif
+	  _GLIBCXX_TSAN_MUTEX_POST_UNLOCK(&_M_val);
 	}
 
 	// Swaps the values of *this and __c, and unlocks *this.
@@ -591,7 +579,8 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	{
 #if __glibcxx_constexpr_memory >= 202506L
 	  if consteval {
-	    while(true); // if we are waiting, no one will change it as constant evaluation is single threaded environment
+	    // No other thread can change the value.
+	    ce__atomic_wait_would_block_forever();
 	  }
 	  auto __v = _M_val.load(memory_order_relaxed);
 	  unlock(memory_order_relaxed);
@@ -716,6 +705,30 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	return __ret;
       }
 
+      // Equivalent to load(__o).lock() for a weak_ptr, but goes straight
+      // from the stored control block to a new shared owner while the lock
+      // is held, so the weak count is never incremented and decremented.
+      _GLIBCXX26_CONSTEXPR
+      auto
+      load_locked(memory_order __o) const noexcept
+      requires (!__is_shared_ptr<_Tp>)
+      {
+	__glibcxx_assert(__o != memory_order_release
+			   && __o != memory_order_acq_rel);
+	if (__o != memory_order_seq_cst)
+	  __o = memory_order_acquire;
+
+	decltype(std::declval<const _Tp&>().lock()) __ret;
+	auto __pi = _M_refcount.lock(__o);
+	if (__pi && __pi->_M_add_ref_lock_nothrow())
+	  {
+	    __ret._M_ptr = _M_ptr;
+	    __ret._M_refcount._M_pi = __pi;
+	  }
+	_M_refcount.unlock(memory_order_relaxed);
+	return __ret;
+      }
+
       _GLIBCXX26_CONSTEXPR
       void
       swap(value_type& __r, memory_order __o) noexcept
@@ -941,6 +954,18 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       operator weak_ptr<_Tp>() const noexcept
       { return _M_impl.load(memory_order_seq_cst); }
 
+      // Non-standard: equivalent to load(__o).lock() but promotes the
+      // stored value with a single update of the use count.
+      _GLIBCXX26_CONSTEXPR
+      shared_ptr<_Tp>
+      load_locked(memory_order __o = memory_order_seq_cst) const noexcept
+      { return _M_impl.load_locked(__o); }
+
+      _GLIBCXX26_CONSTEXPR
+      shared_ptr<_Tp>
+      lock(memory_order __o = memory_order_seq_cst) const noexcept
+      { return _M_impl.load_locked(__o); }
+
       _GLIBCXX26_CONSTEXPR
       void
       store(weak_ptr<_Tp> __desired,
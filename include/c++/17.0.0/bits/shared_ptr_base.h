@@ -64,6 +64,10 @@
 # include <compare>
 # include <bits/align.h> // std::align
 # include <bits/stl_uninitialized.h>
+# ifdef _GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD
+#  include <cstddef> // std::max_align_t
+#  include <cstdlib> // std::calloc, std::free
+# endif
 #endif
 
 #define __glibcxx_want_constexpr_memory
@@ -125,6 +129,51 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       enum { _S_need_barriers = 1 };
     };
 
+#ifdef _GLIBCXX_SP_INSTRUMENT
+# if __cplusplus < 201703L
+#  error "_GLIBCXX_SP_INSTRUMENT requires C++17 or later"
+# endif
+  // With _GLIBCXX_SP_INSTRUMENT defined, every control block reports these
+  // events to the hook installed by __gnu_cxx::set_sp_hook, which is in
+  // <ext/sp_instrument.h>. Nothing is reported during constant evaluation.
+  enum class _Sp_event : unsigned char
+  {
+    _S_create,		// A control block was constructed.
+    _S_add_ref,		// The use count was incremented, by a copy or a lock.
+    _S_release,		// The use count is being decremented.
+    _S_weak_add_ref,	// The weak count was incremented.
+    _S_weak_release,	// The weak count is being decremented.
+    _S_dispose,		// The owned object is being destroyed.
+    _S_destroy		// The control block is being destroyed.
+  };
+
+  // __cb is the control block, __ti the type of the owned object (null
+  // without RTTI) and __bytes the size of the control block's allocation,
+  // which includes the object for make_shared and allocate_shared.
+  using _Sp_hook = void (*)(_Sp_event __e, const void* __cb,
+			    const type_info* __ti, size_t __bytes) noexcept;
+
+  inline _Sp_hook __sp_hook = nullptr;
+
+  template<typename _Tp>
+    constexpr const type_info*
+    __sp_typeid() noexcept
+    {
+#if __cpp_rtti
+      return &typeid(_Tp);
+#else
+      return nullptr;
+#endif
+    }
+
+# define _GLIBCXX_SP_EVENT(__e) this->_M_notify(_Sp_event::__e)
+# define _GLIBCXX_SP_CREATED(_Type, __bytes) \
+  this->_M_notify_create(std::__sp_typeid<_Type>(), __bytes)
+#else
+# define _GLIBCXX_SP_EVENT(__e)
+# define _GLIBCXX_SP_CREATED(_Type, __bytes)
+#endif
+
   template<_Lock_policy _Lp = __default_lock_policy>
     class _Sp_counted_base
     : public _Mutex_base<_Lp>
@@ -137,7 +186,14 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       _GLIBCXX26_CONSTEXPR
       virtual
       ~_Sp_counted_base() noexcept
-      { }
+      {
+#ifdef _GLIBCXX_SP_INSTRUMENT
+	// Not if the owned object failed to construct, as the block's
+	// creation was never reported then.
+	if (_M_bytes != 0)
+	  _GLIBCXX_SP_EVENT(_S_destroy);
+#endif
+      }
 
       // Called when _M_use_count drops to zero, to release the resources
       // managed by *this.
@@ -159,7 +215,10 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       _GLIBCXX26_CONSTEXPR
       void
       _M_add_ref_copy()
-      { _S_chk(__gnu_cxx::__exchange_and_add_dispatch(&_M_use_count, 1)); }
+      {
+	_S_chk(__gnu_cxx::__exchange_and_add_dispatch(&_M_use_count, 1));
+	_GLIBCXX_SP_EVENT(_S_add_ref);
+      }
 
       // Increment the use count if it is non-zero, throw otherwise.
       _GLIBCXX26_CONSTEXPR
@@ -186,6 +245,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       _M_release_last_use() noexcept
       {
 	_GLIBCXX_SYNCHRONIZATION_HAPPENS_AFTER(&_M_use_count);
+	_GLIBCXX_SP_EVENT(_S_dispose);
 	_M_dispose();
 	// There must be a memory barrier between dispose() and destroy()
 	// to ensure that the effects of dispose() are observed in the
@@ -198,6 +258,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 
 	// Be race-detector-friendly.  For more info see bits/c++config.
 	_GLIBCXX_SYNCHRONIZATION_HAPPENS_BEFORE(&_M_weak_count);
+	_GLIBCXX_SP_EVENT(_S_weak_release);
 	if (__gnu_cxx::__exchange_and_add_dispatch(&_M_weak_count,
 						   -1) == 1)
 	  {
@@ -223,6 +284,17 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	constexpr _Atomic_word __max = -1;
 	if (__gnu_cxx::__exchange_and_add_dispatch(&_M_weak_count, 1) == __max)
 	  [[__unlikely__]] __builtin_trap();
+	_GLIBCXX_SP_EVENT(_S_weak_add_ref);
+      }
+
+      // Increment the weak count of a control block that was just created,
+      // which no other thread can see yet, so needs no atomic operation.
+      _GLIBCXX26_CONSTEXPR
+      void
+      _M_weak_add_ref_unshared() noexcept
+      {
+	++_M_weak_count;
+	_GLIBCXX_SP_EVENT(_S_weak_add_ref);
       }
 
       // Decrement the weak count.
@@ -230,6 +302,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       void
       _M_weak_release() noexcept
       {
+	_GLIBCXX_SP_EVENT(_S_weak_release);
         // Be race-detector-friendly. For more info see bits/c++config.
         _GLIBCXX_SYNCHRONIZATION_HAPPENS_BEFORE(&_M_weak_count);
 	if (__gnu_cxx::__exchange_and_add_dispatch(&_M_weak_count, -1) == 1)
@@ -251,11 +324,24 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       {
 	// No memory barrier is used here so there is no synchronization
 	// with other threads.
+	_Atomic_word __count;
 #if __glibcxx_constexpr_memory >= 202506L
 	if (__builtin_is_constant_evaluated())
-	  return _M_use_count;
+	  __count = _M_use_count;
+	else
+#endif
+	__count = __atomic_load_n(&_M_use_count, __ATOMIC_RELAXED);
+
+#ifdef _GLIBCXX_SP_FETCH_ADD_LOCK
+	// The low bits of an expired count are junk left by failed locks.
+	if (__count & _S_use_count_dead)
+	  return 0;
+	// A zero that has not been expired yet can still be revived by a
+	// lock, so it is not reported as zero, which would let expired()
+	// be true before a lock() that succeeds.
+	if (_Lp == _S_atomic && __count == 0)
+	  return 1;
 #endif
-	auto __count = __atomic_load_n(&_M_use_count, __ATOMIC_RELAXED);
 
 	// If long is wider than _Atomic_word then we can treat _Atomic_word
 	// as unsigned, and so double its usable range. If the widths are the
@@ -263,6 +349,53 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	return static_cast<_Unsigned_count_type>(__count);
       }
 
+      // True if a single shared owner is the only reference to *this, so no
+      // other thread can observe it while that owner is not shared.
+      _GLIBCXX26_CONSTEXPR
+      bool
+      _M_sole_owner() const noexcept
+      {
+#if __glibcxx_constexpr_memory >= 202506L
+	if (__builtin_is_constant_evaluated())
+	  return _M_use_count == 1 && _M_weak_count == 1;
+#endif
+	return __atomic_load_n(&_M_use_count, __ATOMIC_ACQUIRE) == 1
+	  && __atomic_load_n(&_M_weak_count, __ATOMIC_ACQUIRE) == 1;
+      }
+
+      // Give one shared owner back to a block whose counts have both dropped
+      // to zero, and which _M_destroy() kept for reuse instead of freeing.
+      void
+      _M_revive() noexcept
+      {
+	_M_use_count = 1;
+	_M_weak_count = 1;
+      }
+
+#ifdef _GLIBCXX_SP_INSTRUMENT
+      // Report __e on *this to the installed hook, if there is one.
+      _GLIBCXX26_CONSTEXPR
+      void
+      _M_notify(_Sp_event __e) const noexcept
+      {
+	if (__builtin_is_constant_evaluated())
+	  return;
+	if (_Sp_hook __h = __atomic_load_n(&__sp_hook, __ATOMIC_RELAXED))
+	  __h(__e, this, _M_ti, _M_bytes);
+      }
+
+    protected:
+      // Called by the constructor of each derived class.
+      _GLIBCXX26_CONSTEXPR
+      void
+      _M_notify_create(const type_info* __ti, size_t __bytes) noexcept
+      {
+	_M_ti = __ti;
+	_M_bytes = __bytes;
+	_M_notify(_Sp_event::_S_create);
+      }
+#endif
+
     private:
       _Sp_counted_base(_Sp_counted_base const&) = delete;
       _Sp_counted_base& operator=(_Sp_counted_base const&) = delete;
@@ -273,6 +406,38 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       using _Unsigned_count_type = make_unsigned<_Atomic_word>::type;
 #pragma GCC diagnostic pop
 
+#ifdef _GLIBCXX_SP_FETCH_ADD_LOCK
+      // With _GLIBCXX_SP_FETCH_ADD_LOCK defined, _M_add_ref_lock_nothrow()
+      // for _S_atomic increments _M_use_count unconditionally instead of
+      // looping on a compare-and-swap. Once the last shared owner has gone,
+      // _M_use_count is set to this value; a lock attempt that sees the bit
+      // undoes its increment and fails. Counts must then stay below it.
+      static constexpr _Atomic_word _S_use_count_dead
+	= _Atomic_word(~(_Unsigned_count_type(-1) / 2));
+
+      // Called after _M_release() has taken _M_use_count to zero.
+      // Returns false if a concurrent _M_add_ref_lock_nothrow() got in
+      // first and revived the count, so it must not be disposed yet.
+      // A lock that revives a zero count also takes a weak reference for
+      // the releaser, which is between its decrement and this call and
+      // holds nothing else that keeps *this alive; on failure the caller
+      // must drop it with _M_weak_release().
+      _GLIBCXX26_CONSTEXPR
+      bool
+      _M_expire_use_count() noexcept
+      {
+	if (__gnu_cxx::__is_single_threaded())
+	  {
+	    _M_use_count = _S_use_count_dead;
+	    return true;
+	  }
+	_Atomic_word __zero = 0;
+	return __atomic_compare_exchange_n(&_M_use_count, &__zero,
+					   _S_use_count_dead, false,
+					   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+      }
+#endif
+
       // Called when incrementing _M_use_count to cause a trap on overflow.
       // This should be passed the value of the counter before the increment.
       _GLIBCXX26_CONSTEXPR
@@ -297,8 +462,15 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	// maximum positive value. We cannot use negative counts because they
 	// would not fit in [0,LONG_MAX) after casting to an unsigned type,
 	// which would cause use_count() to return bogus values.
+	//
+	// With _GLIBCXX_SP_FETCH_ADD_LOCK the sign bit is _S_use_count_dead,
+	// so negative counts are never valid.
+#ifdef _GLIBCXX_SP_FETCH_ADD_LOCK
+	constexpr _Atomic_word __max = __max_atomic_word;
+#else
 	constexpr _Atomic_word __max
 	  = sizeof(long) > sizeof(_Atomic_word) ? -1 : __max_atomic_word;
+#endif
 
 	if (__count == __max) [[__unlikely__]]
 	  __builtin_trap();
@@ -306,6 +478,10 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 
       _Atomic_word  _M_use_count;     // #shared
       _Atomic_word  _M_weak_count;    // #weak + (#shared != 0)
+#ifdef _GLIBCXX_SP_INSTRUMENT
+      const type_info* _M_ti = nullptr;
+      size_t _M_bytes = 0;
+#endif
     };
 
   // We use __atomic_add_single and __exchange_and_add_single in the _S_single
@@ -318,6 +494,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
     {
       _S_chk(_M_use_count);
       __gnu_cxx::__atomic_add_single(&_M_use_count, 1);
+      _GLIBCXX_SP_EVENT(_S_add_ref);
     }
 
   template<>
@@ -325,6 +502,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
     inline void
     _Sp_counted_base<_S_single>::_M_weak_release() noexcept
     {
+      _GLIBCXX_SP_EVENT(_S_weak_release);
       if (__gnu_cxx::__exchange_and_add_single(&_M_weak_count, -1) == 1)
 	_M_destroy();
     }
@@ -385,6 +563,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	  _M_use_count = 0;
 	  return false;
 	}
+      _GLIBCXX_SP_EVENT(_S_add_ref);
       return true;
 #if defined(__clang__) && __glibcxx_constexpr_memory >= 202506L
       }
@@ -397,6 +576,32 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
     _Sp_counted_base<_S_atomic>::
     _M_add_ref_lock_nothrow() noexcept
     {
+#ifdef _GLIBCXX_SP_FETCH_ADD_LOCK
+      if (!__gnu_cxx::__is_single_threaded())
+	{
+	  // A single unconditional increment, which cannot fail and retry
+	  // under contention the way the CAS loop below can. A count of zero
+	  // that has not been expired yet is still live: the _M_release()
+	  // that reached zero will fail to expire it and leave the object
+	  // to us.
+	  _Atomic_word __count = __atomic_fetch_add(&_M_use_count, 1,
+						    __ATOMIC_ACQ_REL);
+	  if (__count & _S_use_count_dead) [[__unlikely__]]
+	    {
+	      // Already disposed. Roll back so that failed locks cannot
+	      // accumulate and carry the count out of the dead range.
+	      __atomic_fetch_sub(&_M_use_count, 1, __ATOMIC_RELAXED);
+	      return false;
+	    }
+	  if (__count == 0) [[__unlikely__]]
+	    // Keep *this alive for the releaser whose _M_expire_use_count()
+	    // this makes fail. Our use count stops it being disposed first.
+	    __atomic_fetch_add(&_M_weak_count, 1, __ATOMIC_RELAXED);
+	  _S_chk(__count);
+	  _GLIBCXX_SP_EVENT(_S_add_ref);
+	  return true;
+	}
+#endif
       // Perform lock-free add-if-not-zero operation.
       _Atomic_word __count = _M_get_use_count();
       do
@@ -419,6 +624,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 					  __ATOMIC_RELAXED));
 #endif
       _S_chk(__count);
+      _GLIBCXX_SP_EVENT(_S_add_ref);
       return true;
     }
 
@@ -427,8 +633,10 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
     inline void
     _Sp_counted_base<_S_single>::_M_release() noexcept
     {
+      _GLIBCXX_SP_EVENT(_S_release);
       if (__gnu_cxx::__exchange_and_add_single(&_M_use_count, -1) == 1)
         {
+	  _GLIBCXX_SP_EVENT(_S_dispose);
 	  _M_dispose();
 	  _M_weak_release();
         }
@@ -439,6 +647,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
     inline void
     _Sp_counted_base<_S_mutex>::_M_release() noexcept
     {
+      _GLIBCXX_SP_EVENT(_S_release);
       // Be race-detector-friendly.  For more info see bits/c++config.
       _GLIBCXX_SYNCHRONIZATION_HAPPENS_BEFORE(&_M_use_count);
       if (__gnu_cxx::__exchange_and_add_dispatch(&_M_use_count, -1) == 1)
@@ -454,8 +663,8 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
     {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wc++17-extensions" // if constexpr
+      _GLIBCXX_SP_EVENT(_S_release);
       _GLIBCXX_SYNCHRONIZATION_HAPPENS_BEFORE(&_M_use_count);
-#if !(__glibcxx_constexpr_memory >= 202506L)
 #if ! _GLIBCXX_TSAN
       constexpr bool __lock_free
 	= __atomic_always_lock_free(sizeof(long long), 0)
@@ -466,43 +675,83 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       // alignof(void*).
       constexpr bool __aligned = __alignof(long long) <= alignof(void*);
       if constexpr (__lock_free && __double_word && __aligned)
-	{
-	  constexpr int __wordbits = __CHAR_BIT__ * sizeof(_Atomic_word);
-	  constexpr int __shiftbits = __double_word ? __wordbits : 0;
-	  constexpr long long __unique_ref = 1LL + (1LL << __shiftbits);
-	  auto __both_counts = reinterpret_cast<long long*>(&_M_use_count);
+	// Only at run time: constant evaluation cannot read both counts
+	// as one.
+	if (!__builtin_is_constant_evaluated())
+	  {
+	    constexpr int __wordbits = __CHAR_BIT__ * sizeof(_Atomic_word);
+	    constexpr int __shiftbits = __double_word ? __wordbits : 0;
+	    constexpr long long __unique_ref = 1LL + (1LL << __shiftbits);
+	    auto __both_counts = reinterpret_cast<long long*>(&_M_use_count);
 
-	  _GLIBCXX_SYNCHRONIZATION_HAPPENS_BEFORE(&_M_weak_count);
-	  if (__atomic_load_n(__both_counts, __ATOMIC_ACQUIRE) == __unique_ref)
-	    {
-	      // Both counts are 1, so there are no weak references and
-	      // we are releasing the last strong reference. No other
-	      // threads can observe the effects of this _M_release()
-	      // call (e.g. calling use_count()) without a data race.
-	      _M_weak_count = _M_use_count = 0;
-	      _GLIBCXX_SYNCHRONIZATION_HAPPENS_AFTER(&_M_use_count);
-	      _GLIBCXX_SYNCHRONIZATION_HAPPENS_AFTER(&_M_weak_count);
-	      _M_dispose();
-	      _M_destroy();
-	      return;
-	    }
-	  if (__gnu_cxx::__exchange_and_add_dispatch(&_M_use_count, -1) == 1)
-	    [[__unlikely__]]
-	    {
-	      _M_release_last_use_cold();
-	      return;
-	    }
-	}
-      else
+	    _GLIBCXX_SYNCHRONIZATION_HAPPENS_BEFORE(&_M_weak_count);
+	    if (__atomic_load_n(__both_counts, __ATOMIC_ACQUIRE) == __unique_ref)
+	      {
+		// Both counts are 1, so there are no weak references and
+		// we are releasing the last strong reference. No other
+		// threads can observe the effects of this _M_release()
+		// call (e.g. calling use_count()) without a data race.
+		_M_weak_count = _M_use_count = 0;
+		_GLIBCXX_SYNCHRONIZATION_HAPPENS_AFTER(&_M_use_count);
+		_GLIBCXX_SYNCHRONIZATION_HAPPENS_AFTER(&_M_weak_count);
+		_GLIBCXX_SP_EVENT(_S_dispose);
+		_M_dispose();
+		_GLIBCXX_SP_EVENT(_S_weak_release);
+		_M_destroy();
+		return;
+	      }
+	    if (__gnu_cxx::__exchange_and_add_dispatch(&_M_use_count, -1) == 1)
+	      [[__unlikely__]]
+	      {
+#ifdef _GLIBCXX_SP_FETCH_ADD_LOCK
+		if (!_M_expire_use_count())
+		  {
+		    _M_weak_release();
+		    return;
+		  }
 #endif
+		_M_release_last_use_cold();
+	      }
+	    return;
+	  }
 #endif
       if (__gnu_cxx::__exchange_and_add_dispatch(&_M_use_count, -1) == 1)
 	{
+#ifdef _GLIBCXX_SP_FETCH_ADD_LOCK
+	  if (!_M_expire_use_count())
+	    {
+	      _M_weak_release();
+	      return;
+	    }
+#endif
 	  _M_release_last_use();
 	}
 #pragma GCC diagnostic pop
     }
 
+  // Hash the address held by a smart pointer or its control block.
+  // Heap addresses are aligned, so an identity hash (which is what
+  // std::hash<T*> is) leaves the low bits constant and clusters badly in
+  // power-of-two tables. A multiply between two xor-folds lets every bit
+  // of the address reach the low bits.
+  template<typename _Ptr>
+    _GLIBCXX26_CONSTEXPR
+    inline size_t
+    __sp_hash_address(_Ptr __p) noexcept
+    {
+#if __glibcxx_constexpr_memory >= 202506L
+      // An address has no value during constant evaluation. Hashing all
+      // non-null pointers alike is still consistent with equality.
+      if (__builtin_is_constant_evaluated())
+	return __p != nullptr;
+#endif
+      constexpr int __half = __CHAR_BIT__ * sizeof(size_t) / 2;
+      size_t __h = reinterpret_cast<__UINTPTR_TYPE__>(__p);
+      __h ^= __h >> __half;
+      __h *= size_t(0x9e3779b97f4a7c15ULL);
+      return __h ^ (__h >> __half);
+    }
+
   // Forward declarations.
   template<typename _Tp, _Lock_policy _Lp = __default_lock_policy>
     class __shared_ptr;
@@ -536,6 +785,8 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
     class _Sp_atomic;
 #endif
 
+  struct _Sp_block_access;
+
   // Counted ptr with no deleter or allocator support
   template<typename _Ptr, _Lock_policy _Lp>
     class _Sp_counted_ptr final : public _Sp_counted_base<_Lp>
@@ -544,7 +795,11 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       _GLIBCXX26_CONSTEXPR
       explicit
       _Sp_counted_ptr(_Ptr __p) noexcept
-      : _M_ptr(__p) { }
+      : _M_ptr(__p)
+      {
+	_GLIBCXX_SP_CREATED(typename remove_pointer<_Ptr>::type,
+			    sizeof(*this));
+      }
 
       _GLIBCXX26_CONSTEXPR
       virtual void
@@ -633,12 +888,20 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       // __d(__p) must not throw.
       _GLIBCXX26_CONSTEXPR
       _Sp_counted_deleter(_Ptr __p, _Deleter __d) noexcept
-      : _M_del{std::move(__d)}, _M_alloc{}, _M_ptr(__p) { }
+      : _M_del{std::move(__d)}, _M_alloc{}, _M_ptr(__p)
+      {
+	_GLIBCXX_SP_CREATED(typename remove_pointer<_Ptr>::type,
+			    sizeof(*this));
+      }
 
       // __d(__p) must not throw.
       _GLIBCXX26_CONSTEXPR
       _Sp_counted_deleter(_Ptr __p, _Deleter __d, const _Alloc& __a) noexcept
-      : _M_del{std::move(__d)}, _M_alloc{__a}, _M_ptr(__p) { }
+      : _M_del{std::move(__d)}, _M_alloc{__a}, _M_ptr(__p)
+      {
+	_GLIBCXX_SP_CREATED(typename remove_pointer<_Ptr>::type,
+			    sizeof(*this));
+      }
 
 #pragma GCC diagnostic push // PR tree-optimization/122197
 #pragma GCC diagnostic ignored "-Wfree-nonheap-object"
@@ -724,6 +987,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	  // 2070.  allocate_shared should use allocator_traits<A>::construct
 	  allocator_traits<_Alloc>::construct(__a, _M_ptr(),
 	      std::forward<_Args>(__args)...); // might throw
+	  _GLIBCXX_SP_CREATED(_Tp, sizeof(*this));
 	}
 
 #pragma GCC diagnostic push // PR tree-optimization/122197
@@ -811,6 +1075,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       : _M_alloc(__a)
       {
 	::new((void*)_M_ptr()) _Tp; // default-initialized, for overwrite.
+	_GLIBCXX_SP_CREATED(_Tp, sizeof(*this));
       }
 
       ~_Sp_counted_ptr_inplace() noexcept { }
@@ -841,19 +1106,79 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 #if __glibcxx_shared_ptr_arrays >= 201707L // C++ >= 20 && HOSTED
   struct _Sp_overwrite_tag;
 
+#ifdef _GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD
+  // Allocator for make_shared<T[]> of large arrays of elements that are
+  // value-initialized to all zero bits. Memory from calloc is zero already,
+  // often as fresh pages that are not touched until they are used, so the
+  // elements are left as they are.
+  template<typename _Tp>
+    struct __sp_zeroed_allocator
+    {
+      using value_type = _Tp;
+
+      __sp_zeroed_allocator() = default;
+
+      template<typename _Up>
+	constexpr
+	__sp_zeroed_allocator(const __sp_zeroed_allocator<_Up>&) noexcept
+	{ }
+
+      _Tp*
+      allocate(size_t __n)
+      {
+	static_assert(alignof(_Tp) <= alignof(max_align_t));
+	if (void* __p = std::calloc(__n, sizeof(_Tp)))
+	  return static_cast<_Tp*>(__p);
+	std::__throw_bad_alloc();
+      }
+
+      void
+      deallocate(_Tp* __p, size_t) noexcept
+      { std::free(__p); }
+
+      template<typename _Up>
+	friend constexpr bool
+	operator==(const __sp_zeroed_allocator&,
+		   const __sp_zeroed_allocator<_Up>&) noexcept
+	{ return true; }
+    };
+
+  template<typename _Alloc>
+    constexpr bool __is_sp_zeroed_allocator = false;
+
+  template<typename _Tp>
+    constexpr bool __is_sp_zeroed_allocator<__sp_zeroed_allocator<_Tp>>
+      = true;
+#endif // _GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD
+
   // For make_shared<T[]>, make_shared<T[N]>, allocate_shared<T[]> etc.
   template<typename _Alloc>
     struct _Sp_counted_array_base
     {
+      // The top bit of _M_n is set if the elements were default-initialized
+      // by make_shared_for_overwrite, which no array can have enough of to
+      // need it for the count.
+      static constexpr size_t _S_overwrite_bit = ~(size_t(-1) >> 1);
+
       [[no_unique_address]] _Alloc _M_alloc{};
       size_t _M_n = 0;
-      bool _M_overwrite = false;
+
+      // The number of elements.
+      _GLIBCXX26_CONSTEXPR
+      size_t
+      _M_size() const noexcept
+      { return _M_n & ~_S_overwrite_bit; }
+
+      _GLIBCXX26_CONSTEXPR
+      bool
+      _M_overwrite() const noexcept
+      { return _M_n & _S_overwrite_bit; }
 
       _GLIBCXX26_CONSTEXPR
       typename allocator_traits<_Alloc>::pointer
       _M_alloc_array(size_t __tail)
       {
-	return allocator_traits<_Alloc>::allocate(_M_alloc, _M_n + __tail);
+	return allocator_traits<_Alloc>::allocate(_M_alloc, _M_size() + __tail);
       }
 
       _GLIBCXX26_CONSTEXPR
@@ -861,7 +1186,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       _M_dealloc_array(typename allocator_traits<_Alloc>::pointer __p,
 		       size_t __tail)
       {
-	allocator_traits<_Alloc>::deallocate(_M_alloc, __p, _M_n + __tail);
+	allocator_traits<_Alloc>::deallocate(_M_alloc, __p, _M_size() + __tail);
       }
 
       // Init the array elements
@@ -876,13 +1201,19 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 
 	  if constexpr (is_same_v<_Init, _Sp_overwrite_tag>)
 	    {
-	      std::uninitialized_default_construct_n(__p, _M_n);
-	      _M_overwrite = true;
+	      std::uninitialized_default_construct_n(__p, _M_size());
+	      _M_n |= _S_overwrite_bit;
 	    }
 	  else if (__init == nullptr)
-	    std::__uninitialized_default_n_a(__p, _M_n, _M_alloc);
+	    {
+#ifdef _GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD
+	      if constexpr (__is_sp_zeroed_allocator<_Alloc>)
+		return; // calloc left the elements zero.
+#endif
+	      std::__uninitialized_default_n_a(__p, _M_size(), _M_alloc);
+	    }
 	  else if constexpr (!is_array_v<_Tp>)
-	    std::__uninitialized_fill_n_a(__p, _M_n, *__init, _M_alloc);
+	    std::__uninitialized_fill_n_a(__p, _M_size(), *__init, _M_alloc);
 	  else
 	    {
 #pragma GCC diagnostic push
@@ -912,7 +1243,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 
 	      _Iter __first{_S_first_elem(__init), sizeof(_Tp) / sizeof(_Up)};
 	      _Iter __last = __first;
-	      __last._M_pos = _M_n;
+	      __last._M_pos = _M_size();
 	      std::__uninitialized_copy_a(__first, __last, __p, _M_alloc);
 	    }
 	}
@@ -922,11 +1253,11 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       void
       _M_dispose_array(typename allocator_traits<_Alloc>::value_type* __p)
       {
-	if (_M_overwrite)
-	  std::destroy_n(__p, _M_n);
+	if (_M_overwrite())
+	  std::destroy_n(__p, _M_size());
 	else
 	  {
-	    size_t __n = _M_n;
+	    size_t __n = _M_size();
 	    while (__n--)
 	      allocator_traits<_Alloc>::destroy(_M_alloc, __p + __n);
 	  }
@@ -949,10 +1280,49 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
     : public _Sp_counted_base<_Lp>, _Sp_counted_array_base<_Alloc>
     {
       using pointer = typename allocator_traits<_Alloc>::pointer;
+      using value_type = typename allocator_traits<_Alloc>::value_type;
+
+      // The alignment of this block, when it does not store _M_alloc_ptr.
+      static constexpr size_t _S_align
+	= alignof(_Sp_counted_base<_Lp>) > alignof(_Sp_counted_array_base<_Alloc>)
+	    ? alignof(_Sp_counted_base<_Lp>)
+	    : alignof(_Sp_counted_array_base<_Alloc>);
+
+      // Whether the allocation is aligned for the block, so that the block
+      // is placed at a fixed distance from the start, which it need not
+      // store. That is so if the elements are, or if std::allocator gets
+      // the memory from operator new.
+      static constexpr bool _S_derive_ptr
+	= is_pointer<pointer>::value
+	    && (alignof(value_type) >= _S_align
+		  || (is_same<_Alloc, allocator<value_type>>::value
+			&& _S_align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__));
+
+      struct _No_ptr
+      {
+	explicit _No_ptr(pointer) noexcept { }
+      };
 
-      pointer _M_alloc_ptr;
+      [[__no_unique_address__]]
+	__conditional_t<_S_derive_ptr, _No_ptr, pointer> _M_alloc_ptr;
+
+      // The start of the allocation, where the array is.
+      pointer
+      _M_alloc_start() const noexcept
+      {
+	if constexpr (_S_derive_ptr)
+	  {
+	    static_assert(alignof(_Sp_counted_array) == _S_align);
+	    size_t __off = this->_M_size() * sizeof(value_type);
+	    __off = (__off + _S_align - 1) & ~(_S_align - 1);
+	    auto __this = reinterpret_cast<const char*>(this);
+	    return reinterpret_cast<pointer>(const_cast<char*>(__this - __off));
+	  }
+	else
+	  return _M_alloc_ptr;
+      }
 
-      auto _M_ptr() const noexcept { return std::to_address(_M_alloc_ptr); }
+      auto _M_ptr() const noexcept { return std::to_address(_M_alloc_start()); }
 
       friend class __shared_count<_Lp>; // To be able to call _M_ptr().
 
@@ -960,14 +1330,18 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       _Sp_counted_array(const _Sp_counted_array_base<_Alloc>& __a,
 			pointer __p) noexcept
       : _Sp_counted_array_base<_Alloc>(__a), _M_alloc_ptr(__p)
-      { }
+      {
+	_GLIBCXX_SP_CREATED(typename allocator_traits<_Alloc>::value_type[],
+			    (this->_M_size() + _S_tail())
+			      * sizeof(typename allocator_traits<_Alloc>::value_type));
+      }
 
       ~_Sp_counted_array() = default;
 
       virtual void
       _M_dispose() noexcept
       {
-	if (this->_M_n)
+	if (this->_M_size())
 	  this->_M_dispose_array(_M_ptr());
       }
 
@@ -976,7 +1350,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       _M_destroy() noexcept
       {
 	_Sp_counted_array_base<_Alloc> __a = *this;
-	pointer __p = _M_alloc_ptr;
+	pointer __p = _M_alloc_start();
 	this->~_Sp_counted_array();
 	__a._M_dealloc_array(__p, _S_tail());
       }
@@ -1014,6 +1388,93 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       void operator()(_Yp* __p) const { delete[] __p; }
   };
 
+#if __cplusplus > 201703L
+  template<typename _Tp, _Lock_policy _Lp>
+    struct _Sp_promotable_storage;
+
+  // The deleter of a unique_ptr made by __gnu_cxx::make_unique_promotable.
+  // Converting such a unique_ptr to shared_ptr does not allocate, but
+  // constructs the control block in space left for it next to the object.
+  template<typename _Tp, _Lock_policy _Lp = __default_lock_policy>
+    struct _Sp_promotable_delete
+    {
+      _Sp_promotable_storage<_Tp, _Lp>* _M_storage = nullptr;
+
+      _GLIBCXX26_CONSTEXPR
+      void
+      operator()(_Tp* __p) const noexcept
+      {
+	std::destroy_at(__p);
+	delete _M_storage;
+      }
+    };
+
+  // Control block constructed in an _Sp_promotable_storage.
+  template<typename _Tp, _Lock_policy _Lp>
+    class _Sp_counted_promoted final : public _Sp_counted_base<_Lp>
+    {
+    public:
+      _GLIBCXX26_CONSTEXPR
+      explicit
+      _Sp_counted_promoted(_Sp_promotable_storage<_Tp, _Lp>* __s) noexcept
+      : _M_del{__s}
+      { _GLIBCXX_SP_CREATED(_Tp, sizeof(*__s)); }
+
+      _GLIBCXX26_CONSTEXPR
+      ~_Sp_counted_promoted() noexcept { }
+
+      _GLIBCXX26_CONSTEXPR
+      void
+      _M_dispose() noexcept override
+      { std::destroy_at(std::__addressof(_M_del._M_storage->_M_obj)); }
+
+      _GLIBCXX26_CONSTEXPR
+      void
+      _M_destroy() noexcept override
+      {
+	_Sp_promotable_storage<_Tp, _Lp>* __s = _M_del._M_storage;
+	this->~_Sp_counted_promoted();
+	delete __s;
+      }
+
+      // The deleter of the unique_ptr is kept, so that get_deleter finds
+      // it after the conversion as it would with any other deleter.
+      _GLIBCXX26_CONSTEXPR
+      void*
+      _M_get_deleter(const type_info& __ti [[__gnu__::__unused__]]) noexcept
+      override
+      {
+#if __cpp_rtti
+	if (__ti == typeid(_Sp_promotable_delete<_Tp, _Lp>))
+	  return std::__addressof(_M_del);
+#endif
+	return nullptr;
+      }
+
+    private:
+      _Sp_promotable_delete<_Tp, _Lp> _M_del;
+    };
+
+  // An object, and room for its control block should it become shared.
+  // Each member's lifetime is managed by hand.
+  template<typename _Tp, _Lock_policy _Lp>
+    struct _Sp_promotable_storage
+    {
+      template<typename... _Args>
+	_GLIBCXX26_CONSTEXPR
+	explicit
+	_Sp_promotable_storage(_Args&&... __args)
+	: _M_obj(std::forward<_Args>(__args)...)
+	{ }
+
+      _GLIBCXX26_CONSTEXPR
+      ~_Sp_promotable_storage() { }
+
+      union { _Tp _M_obj; };
+      union { _Sp_counted_promoted<_Tp, _Lp> _M_block; };
+    };
+#endif // C++20
+
   template<_Lock_policy _Lp>
     class __shared_count
     {
@@ -1142,7 +1603,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	  _Up* const __raw = std::to_address(__guard._M_ptr);
 	  __guard._M_init(__raw, __init); // might throw
 
-	  void* __c = __raw + __a._M_n;
+	  void* __c = __raw + __a._M_size();
 	  if constexpr (alignof(_Up) < alignof(_Sp_ca_type))
 	    {
 	      size_t __space = sizeof(_Up) * __tail;
@@ -1195,6 +1656,26 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	  _M_pi = __mem;
 	}
 
+#if __cplusplus > 201703L
+      // A unique_ptr from make_unique_promotable brings the space for its
+      // control block with it.
+      template<typename _Tp>
+	explicit
+	_GLIBCXX26_CONSTEXPR
+	__shared_count(std::unique_ptr<_Tp,
+				       _Sp_promotable_delete<_Tp, _Lp>>&& __r)
+	noexcept
+	: _M_pi(nullptr)
+	{
+	  if (__r.get() == nullptr)
+	    return;
+
+	  _Sp_promotable_storage<_Tp, _Lp>* __s = __r.get_deleter()._M_storage;
+	  _M_pi = std::construct_at(std::__addressof(__s->_M_block), __s);
+	  __r.release();
+	}
+#endif
+
       // Throw bad_weak_ptr when __r._M_get_use_count() == 0.
       _GLIBCXX26_CONSTEXPR
       explicit __shared_count(const __weak_count<_Lp>& __r);
@@ -1269,12 +1750,14 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       { return std::less<_Sp_counted_base<_Lp>*>()(this->_M_pi, __rhs._M_pi); }
 
 #ifdef __glibcxx_smart_ptr_owner_equality // >= C++26
+      _GLIBCXX26_CONSTEXPR
       size_t
       _M_owner_hash() const noexcept
-      { return std::hash<_Sp_counted_base<_Lp>*>()(this->_M_pi); }
+      { return std::__sp_hash_address(this->_M_pi); }
 #endif
 
       // Friend function injected into enclosing namespace and found by ADL
+      _GLIBCXX26_CONSTEXPR
       friend inline bool
       operator==(const __shared_count& __a, const __shared_count& __b) noexcept
       { return __a._M_pi == __b._M_pi; }
@@ -1287,6 +1770,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 #ifdef __glibcxx_out_ptr
       template<typename, typename, typename...> friend class out_ptr_t;
 #endif
+      friend struct _Sp_block_access;
 
       _Sp_counted_base<_Lp>*  _M_pi;
     };
@@ -1364,6 +1848,18 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	return *this;
       }
 
+      // As operator=(__r), for a __r that has just created its control
+      // block, and has not been copied.
+      _GLIBCXX26_CONSTEXPR
+      void
+      _M_assign_unshared(const __shared_count<_Lp>& __r) noexcept
+      {
+	if (_M_pi != nullptr)
+	  *this = __r;
+	else if ((_M_pi = __r._M_pi) != nullptr)
+	  _M_pi->_M_weak_add_ref_unshared();
+      }
+
       _GLIBCXX26_CONSTEXPR
       void
       _M_swap(__weak_count& __r) noexcept
@@ -1389,12 +1885,14 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       { return std::less<_Sp_counted_base<_Lp>*>()(this->_M_pi, __rhs._M_pi); }
 
 #ifdef __glibcxx_smart_ptr_owner_equality // >= C++26
+      _GLIBCXX26_CONSTEXPR
       size_t
       _M_owner_hash() const noexcept
-      { return std::hash<_Sp_counted_base<_Lp>*>()(this->_M_pi); }
+      { return std::__sp_hash_address(this->_M_pi); }
 #endif
 
       // Friend function injected into enclosing namespace and found by ADL
+      _GLIBCXX26_CONSTEXPR
       friend inline bool
       operator==(const __weak_count& __a, const __weak_count& __b) noexcept
       { return __a._M_pi == __b._M_pi; }
@@ -1918,14 +2416,17 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       /// @}
 
 #ifdef __glibcxx_smart_ptr_owner_equality // >= C++26
+      _GLIBCXX26_CONSTEXPR
       size_t owner_hash() const noexcept { return _M_refcount._M_owner_hash(); }
 
       template<typename _Tp1>
+	_GLIBCXX26_CONSTEXPR
 	bool
 	owner_equal(__shared_ptr<_Tp1, _Lp> const& __rhs) const noexcept
 	{ return _M_refcount == __rhs._M_refcount; }
 
       template<typename _Tp1>
+	_GLIBCXX26_CONSTEXPR
 	bool
 	owner_equal(__weak_ptr<_Tp1, _Lp> const& __rhs) const noexcept
 	{ return _M_refcount == __rhs._M_refcount; }
@@ -2013,15 +2514,89 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 
 #ifdef __glibcxx_atomic_shared_ptr
       friend _Sp_atomic<shared_ptr<_Tp>>;
+      friend _Sp_atomic<weak_ptr<_Tp>>; // For _Sp_atomic::load_locked.
 #endif
 #ifdef __glibcxx_out_ptr
       template<typename, typename, typename...> friend class out_ptr_t;
 #endif
+      friend struct _Sp_block_access;
 
       element_type*	   _M_ptr;         // Contained pointer.
       __shared_count<_Lp>  _M_refcount;    // Reference counter.
     };
 
+  // For extensions that define control block types of their own: lets
+  // them hand out a __shared_ptr that owns one, and find the control block
+  // that a __shared_ptr shares.
+  struct _Sp_block_access
+  {
+    // __sp must be empty. It takes over the reference that __pi was
+    // created with, and points to __p, which __pi must manage.
+    template<typename _Tp, _Lock_policy _Lp>
+      _GLIBCXX26_CONSTEXPR
+      static void
+      _S_adopt(__shared_ptr<_Tp, _Lp>& __sp,
+	       typename __shared_ptr<_Tp, _Lp>::element_type* __p,
+	       _Sp_counted_base<_Lp>* __pi) noexcept
+      {
+	__glibcxx_assert(__sp._M_refcount._M_pi == nullptr);
+	__sp._M_ptr = __p;
+	__sp._M_refcount._M_pi = __pi;
+	__sp._M_enable_shared_from_this_with(__p);
+      }
+
+    template<typename _Tp, _Lock_policy _Lp>
+      _GLIBCXX26_CONSTEXPR
+      static _Sp_counted_base<_Lp>*
+      _S_block(const __shared_ptr<_Tp, _Lp>& __sp) noexcept
+      { return __sp._M_refcount._M_pi; }
+
+    // Called when the last shared_ptr to *__p has gone but *__p lives on,
+    // to be owned again later. Empties the weak_ptr that an
+    // enable_shared_from_this base of *__p keeps, which would otherwise
+    // hold a weak reference to the old control block forever.
+    template<typename _Tp, _Lock_policy _Lp = __default_lock_policy>
+      static void
+      _S_forget_owner(_Tp* __p) noexcept
+      {
+	using _Sp = __shared_ptr<_Tp, _Lp>;
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wc++17-extensions" // if constexpr
+	if constexpr (_Sp::template __has_esft_base<__remove_cv_t<_Tp>>::value)
+	  if (auto __base = __enable_shared_from_this_base(__shared_count<_Lp>(),
+							   __p))
+	    __base->_M_weak_this.reset();
+#pragma GCC diagnostic pop
+      }
+  };
+
+  // A control block of an extension that stores the object in the block,
+  // as _Sp_counted_ptr_inplace does. _Block is the most derived class,
+  // which overrides _M_dispose and _M_destroy, and _Base the class to
+  // derive from, itself derived from _Sp_counted_base<>.
+  template<typename _Block, typename _Tp, typename _Base = _Sp_counted_base<>>
+    class _Sp_inplace_block : public _Base
+    {
+    public:
+      template<typename... _Args>
+	explicit
+	_Sp_inplace_block(_Args&&... __args)
+	{
+	  ::new (_M_storage._M_addr()) _Tp(std::forward<_Args>(__args)...);
+	  _GLIBCXX_SP_CREATED(_Tp, sizeof(_Block));
+	}
+
+      _Tp*
+      _M_ptr() noexcept { return _M_storage._M_ptr(); }
+
+    private:
+      void*
+      _M_get_deleter(const std::type_info&) noexcept override
+      { return nullptr; }
+
+      __gnu_cxx::__aligned_buffer<_Tp> _M_storage;
+    };
+
 
   // 20.7.2.2.7 shared_ptr comparisons
   template<typename _Tp1, typename _Tp2, _Lock_policy _Lp>
@@ -2328,6 +2903,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	  return *this;
 	}
 
+      _GLIBCXX26_CONSTEXPR
       __weak_ptr&
       operator=(__weak_ptr&& __r) noexcept
       {
@@ -2374,14 +2950,17 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	{ return _M_refcount._M_less(__rhs._M_refcount); }
 
 #ifdef __glibcxx_smart_ptr_owner_equality // >= C++26
+      _GLIBCXX26_CONSTEXPR
       size_t owner_hash() const noexcept { return _M_refcount._M_owner_hash(); }
 
       template<typename _Tp1>
+      _GLIBCXX26_CONSTEXPR
       bool
       owner_equal(const __shared_ptr<_Tp1, _Lp> & __rhs) const noexcept
       { return _M_refcount == __rhs._M_refcount; }
 
       template<typename _Tp1>
+      _GLIBCXX26_CONSTEXPR
       bool
       owner_equal(const __weak_ptr<_Tp1, _Lp> & __rhs) const noexcept
       { return _M_refcount == __rhs._M_refcount; }
@@ -2413,6 +2992,19 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
 	  }
       }
 
+      // As above, when __refcount has just created its control block.
+      _GLIBCXX26_CONSTEXPR
+      void
+      _M_assign_unshared(_Tp* __ptr,
+			 const __shared_count<_Lp>& __refcount) noexcept
+      {
+	if (use_count() == 0)
+	  {
+	    _M_ptr = __ptr;
+	    _M_refcount._M_assign_unshared(__refcount);
+	  }
+      }
+
       template<typename _Tp1, _Lock_policy _Lp1> friend class __shared_ptr;
       template<typename _Tp1, _Lock_policy _Lp1> friend class __weak_ptr;
       friend class __enable_shared_from_this<_Tp, _Lp>;
@@ -2483,39 +3075,50 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
     protected:
       constexpr __enable_shared_from_this() noexcept { }
 
+      _GLIBCXX26_CONSTEXPR
       __enable_shared_from_this(const __enable_shared_from_this&) noexcept { }
 
+      _GLIBCXX26_CONSTEXPR
       __enable_shared_from_this&
       operator=(const __enable_shared_from_this&) noexcept
       { return *this; }
 
+      _GLIBCXX26_CONSTEXPR
       ~__enable_shared_from_this() { }
 
     public:
+      _GLIBCXX26_CONSTEXPR
       __shared_ptr<_Tp, _Lp>
       shared_from_this()
       { return __shared_ptr<_Tp, _Lp>(this->_M_weak_this); }
 
+      _GLIBCXX26_CONSTEXPR
       __shared_ptr<const _Tp, _Lp>
       shared_from_this() const
       { return __shared_ptr<const _Tp, _Lp>(this->_M_weak_this); }
 
 #if __cplusplus > 201402L || !defined(__STRICT_ANSI__) // c++1z or gnu++11
+      _GLIBCXX26_CONSTEXPR
       __weak_ptr<_Tp, _Lp>
       weak_from_this() noexcept
       { return this->_M_weak_this; }
 
+      _GLIBCXX26_CONSTEXPR
       __weak_ptr<const _Tp, _Lp>
       weak_from_this() const noexcept
       { return this->_M_weak_this; }
 #endif
 
     private:
+      // Only called by the constructors of __shared_ptr that create a new
+      // control block, so no other thread can see __n yet.
       template<typename _Tp1>
+	_GLIBCXX26_CONSTEXPR
 	void
 	_M_weak_assign(_Tp1* __p, const __shared_count<_Lp>& __n) const noexcept
-	{ _M_weak_this._M_assign(__p, __n); }
+	{ _M_weak_this._M_assign_unshared(__p, __n); }
 
+      _GLIBCXX26_CONSTEXPR
       friend const __enable_shared_from_this*
       __enable_shared_from_this_base(const __shared_count<_Lp>&,
 				     const __enable_shared_from_this* __p)
@@ -2524,6 +3127,8 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       template<typename, _Lock_policy>
 	friend class __shared_ptr;
 
+      friend struct _Sp_block_access;
+
       mutable __weak_ptr<_Tp, _Lp>  _M_weak_this;
     };
 
@@ -2556,10 +3161,7 @@ _GLIBCXX_BEGIN_NAMESPACE_VERSION
       _GLIBCXX26_CONSTEXPR
       size_t
       operator()(const __shared_ptr<_Tp, _Lp>& __s) const noexcept
-      {
-	return hash<typename __shared_ptr<_Tp, _Lp>::element_type*>()(
-	    __s.get());
-      }
+      { return std::__sp_hash_address(__s.get()); }
     };
 
 _GLIBCXX_END_NAMESPACE_VERSION
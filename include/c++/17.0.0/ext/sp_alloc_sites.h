@@ -0,0 +1,313 @@
+// Allocation sites of live shared_ptr control blocks -*- C++ -*-
+
+// Copyright (C) 2026 Free Software Foundation, Inc.
+//
+// This file is part of the GNU ISO C++ Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+/** @file ext/sp_alloc_sites.h
+ *  This file is a GNU extension to the Standard C++ Library.
+ *
+ *  Requires `_GLIBCXX_SP_INSTRUMENT`, like <ext/sp_instrument.h>, and
+ *  std::stacktrace, so programs using it must link with -lstdc++exp.
+ */
+
+#ifndef _SP_ALLOC_SITES_H
+#define _SP_ALLOC_SITES_H 1
+
+#ifdef _GLIBCXX_SYSHDR
+#pragma GCC system_header
+#endif
+
+#include <ext/sp_instrument.h>
+#include <stacktrace>
+
+#ifndef __cpp_lib_stacktrace
+# error "<ext/sp_alloc_sites.h> requires std::stacktrace"
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  /// The live control blocks created from one call stack.
+  struct sp_alloc_site
+  {
+    std::stacktrace trace;
+    std::size_t blocks;		// Sampled control blocks still alive.
+    std::size_t bytes;		// Their total allocation size.
+  };
+
+  /**
+   *  @brief  Records where shared objects are created, to find what is
+   *          keeping memory alive.
+   *
+   *  `install(__n, __depth)` installs a hook which captures the call stack
+   *  of about one in `__n` control blocks as they are created, whether by
+   *  `make_shared`, `allocate_shared`, a pointer constructor or `out_ptr`,
+   *  and forgets it when they are destroyed. `live()` then groups the
+   *  blocks still alive by call stack. With sampling, multiply the counts
+   *  by `__n` for an estimate.
+   *
+   *  A trace starts in the library, at the constructor of the control
+   *  block, and how many library frames come before the caller depends on
+   *  inlining. So a trace has up to 16 frames more than `__depth`, to
+   *  leave room for those.
+   *
+   *  Capturing a stack is expensive and takes a lock, so only sampled
+   *  creations pay for it; other creations cost a thread-local countdown.
+   *  Destroying a block takes a lock only while sampled blocks are alive.
+   *  Events are forwarded to the previously installed hook.
+   */
+  class sp_alloc_sites
+  {
+  public:
+    static void
+    install(unsigned __every = 1, std::size_t __depth = 16) noexcept
+    {
+      _S_period.store(__every ? __every : 1, std::memory_order_relaxed);
+      _S_depth.store(__depth, std::memory_order_relaxed);
+      sp_hook __prev = set_sp_hook(&_S_hook);
+      if (__prev != &_S_hook)
+	_S_next.store(__prev, std::memory_order_release);
+    }
+
+    /// Restore the previous hook, if ours is still the installed one.
+    /// Destruction is no longer seen, so blocks still alive then stay in
+    /// the report for good.
+    static void
+    uninstall() noexcept
+    {
+      sp_hook __ours = &_S_hook;
+      if (__atomic_compare_exchange_n(&std::__sp_hook, &__ours,
+				      _S_next.load(std::memory_order_acquire),
+				      false, __ATOMIC_ACQ_REL,
+				      __ATOMIC_RELAXED))
+	_S_next.store(nullptr, std::memory_order_release);
+    }
+
+    /// The sites with live blocks, the most bytes first.
+    static std::vector<sp_alloc_site>
+    live()
+    {
+      std::vector<sp_alloc_site> __v;
+      {
+	std::lock_guard<std::mutex> __l(_S_sites_mx());
+	for (auto& [__trace, __site] : _S_sites())
+	  if (std::size_t __n = __site._M_blocks.load())
+	    __v.push_back({__trace, __n, __site._M_bytes.load()});
+      }
+      std::sort(__v.begin(), __v.end(),
+		[](const sp_alloc_site& __a, const sp_alloc_site& __b) {
+		  return __a.bytes > __b.bytes;
+		});
+      return __v;
+    }
+
+    /// Print the @a __n sites with the most live bytes to @a __f.
+    static void
+    print(std::FILE* __f, std::size_t __n = 10)
+    {
+      auto __v = live();
+      if (__v.size() > __n)
+	__v.resize(__n);
+      for (const sp_alloc_site& __s : __v)
+	std::fprintf(__f, "%zu blocks, %zu bytes, from:\n%s\n\n",
+		     __s.blocks, __s.bytes, std::to_string(__s.trace).c_str());
+    }
+
+  private:
+    struct _Site
+    {
+      std::atomic<std::size_t> _M_blocks{0};
+      std::atomic<std::size_t> _M_bytes{0};
+    };
+
+    struct _Block
+    {
+      _Site* _M_site;
+      std::size_t _M_bytes;
+    };
+
+    struct _Shard
+    {
+      std::atomic_flag _M_lock;
+      std::unordered_map<const void*, _Block> _M_blocks;
+    };
+
+    // Scoped spin lock on a shard. Unlike std::mutex it cannot fail, as
+    // _S_destroyed must not throw.
+    struct _Lock
+    {
+      explicit
+      _Lock(_Shard& __s) noexcept
+      : _M_s(__s)
+      {
+	while (_M_s._M_lock.test_and_set(std::memory_order_acquire))
+	  _M_s._M_lock.wait(true, std::memory_order_relaxed);
+      }
+
+      ~_Lock()
+      {
+	_M_s._M_lock.clear(std::memory_order_release);
+	_M_s._M_lock.notify_one();
+      }
+
+      _Lock(const _Lock&) = delete;
+      _Lock& operator=(const _Lock&) = delete;
+
+      _Shard& _M_s;
+    };
+
+    static constexpr std::size_t _S_nshards = 16;
+
+    struct _Shards
+    {
+      _Shard _M_s[_S_nshards];
+
+      // Static shared_ptrs can be destroyed after this, at exit.
+      ~_Shards() { _S_dead.store(true, std::memory_order_relaxed); }
+    };
+
+    // Frames captured beyond the requested depth, for those of the
+    // library between the creating call and the hook.
+    static constexpr std::size_t _S_lib_frames = 16;
+
+    // Sites are never removed, so _Site pointers stay valid.
+    static std::mutex&
+    _S_sites_mx() noexcept
+    {
+      static std::mutex __mx;
+      return __mx;
+    }
+
+    static std::unordered_map<std::stacktrace, _Site>&
+    _S_sites()
+    {
+      static std::unordered_map<std::stacktrace, _Site> __sites;
+      return __sites;
+    }
+
+    static _Shard&
+    _S_shard(const void* __cb) noexcept
+    {
+      static _Shards __shards;
+      return __shards._M_s[std::__sp_hash_address(__cb) % _S_nshards];
+    }
+
+    // Not inlined, so that this function and _S_hook (which is called
+    // through a pointer) are always two frames of their own.
+    __attribute__((__noinline__))
+    static void
+    _S_created(const void* __cb, std::size_t __bytes)
+    {
+      thread_local unsigned __countdown = 0;
+      if (_S_dead.load(std::memory_order_relaxed))
+	return;
+      if (__countdown != 0)
+	{
+	  --__countdown;
+	  return;
+	}
+      __countdown = _S_period.load(std::memory_order_relaxed) - 1;
+
+      std::size_t __depth = _S_depth.load(std::memory_order_relaxed);
+      __depth += std::min(_S_lib_frames, std::size_t(-1) - __depth);
+      // Skip this function and _S_hook.
+      auto __trace = std::stacktrace::current(2, __depth);
+      _Site* __site;
+      {
+	std::lock_guard<std::mutex> __l(_S_sites_mx());
+	__site = &_S_sites()[std::move(__trace)];
+      }
+      _Shard& __sh = _S_shard(__cb);
+      _Lock __l(__sh);
+      if (__sh._M_blocks.emplace(__cb, _Block{__site, __bytes}).second)
+	{
+	  __site->_M_blocks.fetch_add(1, std::memory_order_relaxed);
+	  __site->_M_bytes.fetch_add(__bytes, std::memory_order_relaxed);
+	  _S_tracked.fetch_add(1, std::memory_order_relaxed);
+	}
+    }
+
+    static void
+    _S_destroyed(const void* __cb) noexcept
+    {
+      if (_S_tracked.load(std::memory_order_relaxed) == 0
+	  || _S_dead.load(std::memory_order_relaxed))
+	return;
+      _Shard& __sh = _S_shard(__cb);
+      _Lock __l(__sh);
+      auto __it = __sh._M_blocks.find(__cb);
+      if (__it == __sh._M_blocks.end())
+	return;
+      _Block __b = __it->second;
+      __sh._M_blocks.erase(__it);
+      __b._M_site->_M_blocks.fetch_sub(1, std::memory_order_relaxed);
+      __b._M_site->_M_bytes.fetch_sub(__b._M_bytes, std::memory_order_relaxed);
+      _S_tracked.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    static void
+    _S_hook(sp_event __e, const void* __cb, const std::type_info* __ti,
+	    std::size_t __bytes) noexcept
+    {
+      // The hook does not create shared_ptrs itself, but an allocator
+      // replaced by the program might.
+      thread_local bool __busy = false;
+      if (!__busy)
+	{
+	  __busy = true;
+	  if (__e == sp_event::_S_create)
+	    {
+	      __try
+		{
+		  _S_created(__cb, __bytes);
+		}
+	      __catch(...)
+		{
+		  // Out of memory: this block goes unrecorded.
+		}
+	    }
+	  else if (__e == sp_event::_S_destroy)
+	    _S_destroyed(__cb);
+	  __busy = false;
+	}
+      if (sp_hook __next = _S_next.load(std::memory_order_relaxed))
+	__next(__e, __cb, __ti, __bytes);
+    }
+
+    static inline std::atomic<unsigned> _S_period{1};
+    static inline std::atomic<std::size_t> _S_depth{16};
+    static inline std::atomic<std::size_t> _S_tracked{0};
+    static inline std::atomic<sp_hook> _S_next{nullptr};
+    static inline std::atomic<bool> _S_dead{false};
+  };
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+
+#endif
@@ -0,0 +1,171 @@
+// Creation of many shared objects in one allocation -*- C++ -*-
+
+// Copyright (C) 2026 Free Software Foundation, Inc.
+//
+// This file is part of the GNU ISO C++ Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+/** @file ext/sp_batch.h
+ *  This file is a GNU extension to the Standard C++ Library.
+ */
+
+#ifndef _SP_BATCH_H
+#define _SP_BATCH_H 1
+
+#ifdef _GLIBCXX_SYSHDR
+#pragma GCC system_header
+#endif
+
+#include <bits/requires_hosted.h> // std::shared_ptr, std::vector
+
+#include <memory>
+#include <atomic>
+#include <vector>
+
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  template<typename _Tp>
+    struct _Sp_slab;
+
+  // The control block of an object created by make_shared_batch, one of
+  // an array of them in a slab.
+  template<typename _Tp>
+    class _Sp_slab_block final
+    : public std::_Sp_inplace_block<_Sp_slab_block<_Tp>, _Tp>
+    {
+    public:
+      template<typename... _Args>
+	explicit
+	_Sp_slab_block(_Sp_slab<_Tp>* __s, const _Args&... __args)
+	: std::_Sp_inplace_block<_Sp_slab_block, _Tp>(__args...), _M_slab(__s)
+	{ }
+
+    private:
+      void
+      _M_dispose() noexcept override
+      { this->_M_ptr()->~_Tp(); }
+
+      // Leave the memory to the slab, which frees it with the last block.
+      void
+      _M_destroy() noexcept override
+      {
+	_Sp_slab<_Tp>* __s = _M_slab;
+	this->~_Sp_slab_block();
+	__s->_M_release();
+      }
+
+      _Sp_slab<_Tp>* _M_slab;
+    };
+
+  // The start of the allocation made by make_shared_batch. The blocks
+  // follow it, from the first one not overlapping it.
+  template<typename _Tp>
+    struct _Sp_slab
+    {
+      using _Block = _Sp_slab_block<_Tp>;
+
+      std::atomic<std::size_t> _M_live;	  // Blocks not yet destroyed.
+      std::size_t _M_n;			  // Blocks in the slab.
+
+      // The number of blocks that this header takes the place of.
+      static constexpr std::size_t
+      _S_head() noexcept
+      {
+	static_assert(alignof(_Block) >= alignof(_Sp_slab));
+	return (sizeof(_Sp_slab) + sizeof(_Block) - 1) / sizeof(_Block);
+      }
+
+      _Block*
+      _M_blocks() noexcept
+      { return reinterpret_cast<_Block*>(this) + _S_head(); }
+
+      void
+      _M_release() noexcept
+      {
+	if (_M_live.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	  {
+	    std::size_t __n = _S_head() + _M_n;
+	    _Block* __mem = reinterpret_cast<_Block*>(this);
+	    this->~_Sp_slab();
+	    std::allocator<_Block>().deallocate(__mem, __n);
+	  }
+      }
+    };
+
+  /**
+   *  @brief  Create @a __n objects, each owned separately, in one allocation.
+   *
+   *  Like calling `std::make_shared<_Tp>(__args...)` @a __n times, except
+   *  that the objects and their control blocks are allocated together, one
+   *  after the other. Each object has its own counts, and is destroyed when
+   *  the last shared_ptr to it goes, but the memory is only freed when all
+   *  of them have been destroyed and no weak_ptr refers to any of them.
+   *
+   *  The arguments are passed to each constructor as const lvalues. If one
+   *  of the constructors throws, the objects already made are destroyed and
+   *  the memory freed.
+   *
+   *  Each object takes a pointer more than with make_shared. Use it for
+   *  objects that are created together and mostly die together, as one that
+   *  stays alive keeps the memory of all the others.
+   */
+  template<typename _Tp, typename... _Args>
+    std::vector<std::shared_ptr<_Tp>>
+    make_shared_batch(std::size_t __n, const _Args&... __args)
+    {
+      static_assert(!std::is_array<_Tp>::value, "not an array type");
+      using _Slab = _Sp_slab<std::__remove_cv_t<_Tp>>;
+      using _Block = typename _Slab::_Block;
+
+      std::vector<std::shared_ptr<_Tp>> __v;
+      if (__n == 0)
+	return __v;
+      __v.reserve(__n); // Throws first if __n is too large.
+
+      _Block* __mem = std::allocator<_Block>().allocate(_Slab::_S_head() + __n);
+      _Slab* __s = ::new (static_cast<void*>(__mem)) _Slab{{__n}, __n};
+      _Block* __b = __s->_M_blocks();
+      __try
+	{
+	  for (std::size_t __i = 0; __i < __n; ++__i)
+	    {
+	      ::new (static_cast<void*>(__b + __i)) _Block(__s, __args...);
+	      __v.emplace_back();
+	      std::_Sp_block_access::_S_adopt(__v.back(), __b[__i]._M_ptr(),
+					      __b + __i);
+	    }
+	}
+      __catch(...)
+	{
+	  // Count only the blocks made, and one for us while they go.
+	  __s->_M_live.store(__v.size() + 1, std::memory_order_relaxed);
+	  __v.clear();
+	  __s->_M_release();
+	  __throw_exception_again;
+	}
+      return __v;
+    }
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+
+#endif
@@ -0,0 +1,331 @@
+// Cycle collector for shared_ptr graphs -*- C++ -*-
+
+// Copyright (C) 2026 Free Software Foundation, Inc.
+//
+// This file is part of the GNU ISO C++ Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+/** @file ext/sp_collector.h
+ *  This file is a GNU extension to the Standard C++ Library.
+ */
+
+#ifndef _SP_COLLECTOR_H
+#define _SP_COLLECTOR_H 1
+
+#ifdef _GLIBCXX_SYSHDR
+#pragma GCC system_header
+#endif
+
+#include <bits/requires_hosted.h> // std::shared_ptr, std::mutex
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  class sp_collector;
+
+  // The control block of an object created by make_shared_collectable.
+  class _Sp_collectable_base : public std::_Sp_counted_base<>
+  {
+  protected:
+    using _Block_set = std::unordered_set<std::_Sp_counted_base<>*>;
+
+    // Append the control block of each shared_ptr in the object to __v.
+    virtual void
+    _M_children(std::vector<std::_Sp_counted_base<>*>& __v) = 0;
+
+    // Reset each shared_ptr in the object that shares a block in __s.
+    virtual void
+    _M_clear(const _Block_set& __s) noexcept = 0;
+
+  private:
+    friend class sp_collector;
+
+    _Sp_collectable_base* _M_prev = nullptr;
+    _Sp_collectable_base* _M_next = nullptr;
+  };
+
+  /**
+   *  @brief  Frees cycles of objects created by make_shared_collectable.
+   *
+   *  A group of objects that own each other through shared_ptrs is never
+   *  destroyed, even once nothing else refers to it. If the objects are
+   *  created by `make_shared_collectable`, `collect()` finds such groups
+   *  and breaks them, by trial deletion: for a set of candidate objects,
+   *  it subtracts from each use count the references held by the other
+   *  candidates. An object with references left over is referred to from
+   *  outside the set, so it and everything it refers to are kept. The
+   *  shared_ptr members of the others that point into the set are reset,
+   *  which destroys them as usual.
+   *
+   *  The candidates are all the collectable objects, so `collect()` takes
+   *  time proportional to their number and the shared_ptrs in them.
+   *  `collect_slice(__n)` instead examines about `__n` objects at a time,
+   *  resuming where the last slice stopped, which bounds the pause. Only
+   *  cycles that fit entirely in one slice are found.
+   *
+   *  Other threads may create and destroy collectable objects during a
+   *  collection, but must not meanwhile copy, assign, lock or destroy the
+   *  shared_ptrs and weak_ptrs that refer to them.
+   */
+  class sp_collector
+  {
+  public:
+    /// Free all unreachable cycles. Returns the number of objects freed.
+    static std::size_t
+    collect()
+    { return _S_collect(std::size_t(-1)); }
+
+    /// Examine about @a __budget objects. Returns the number freed.
+    static std::size_t
+    collect_slice(std::size_t __budget)
+    { return _S_collect(__budget ? __budget : 1); }
+
+    /// The number of collectable objects alive.
+    static std::size_t
+    tracked() noexcept
+    {
+      std::lock_guard<std::mutex> __l(_S_mx());
+      return _S_size;
+    }
+
+  private:
+    template<typename> friend class _Sp_collectable_block;
+    template<typename _Tp, typename... _Args>
+      friend std::shared_ptr<_Tp>
+      make_shared_collectable(_Args&&...);
+
+    using _Base = std::_Sp_counted_base<>;
+
+    static std::mutex&
+    _S_mx() noexcept
+    {
+      static std::mutex __mx;
+      return __mx;
+    }
+
+    static std::unordered_set<_Base*>&
+    _S_blocks()
+    {
+      static std::unordered_set<_Base*> __blocks;
+      return __blocks;
+    }
+
+    static void
+    _S_register(_Sp_collectable_base* __b)
+    {
+      std::lock_guard<std::mutex> __l(_S_mx());
+      _S_blocks().insert(__b);
+      __b->_M_next = _S_head;
+      if (_S_head)
+	_S_head->_M_prev = __b;
+      _S_head = __b;
+      ++_S_size;
+    }
+
+    static void
+    _S_unregister(_Sp_collectable_base* __b) noexcept
+    {
+      std::lock_guard<std::mutex> __l(_S_mx());
+      if (!_S_blocks().erase(__b))
+	return; // Its construction failed before it was registered.
+      if (_S_cursor == __b)
+	_S_cursor = __b->_M_next;
+      if (__b->_M_prev)
+	__b->_M_prev->_M_next = __b->_M_next;
+      else
+	_S_head = __b->_M_next;
+      if (__b->_M_next)
+	__b->_M_next->_M_prev = __b->_M_prev;
+      --_S_size;
+    }
+
+    static std::size_t
+    _S_collect(std::size_t __budget)
+    {
+      std::vector<_Sp_collectable_base*> __cand;
+      std::unordered_map<_Base*, std::size_t> __index;
+      std::vector<std::size_t> __edges;	   // Indices in __cand.
+      std::vector<std::size_t> __first;	   // Of each candidate's edges.
+      std::vector<_Base*> __children;
+      _Sp_collectable_base::_Block_set __garbage;
+
+      {
+	std::lock_guard<std::mutex> __l(_S_mx());
+	std::unordered_set<_Base*>& __blocks = _S_blocks();
+
+	// Take seeds from the registry, starting at the cursor, and add
+	// everything collectable that they refer to, up to the budget.
+	// Each candidate's children are all found, but the ones that do
+	// not fit are not candidates.
+	for (std::size_t __seeds = 0;
+	     __seeds < _S_size && __cand.size() < __budget; ++__seeds)
+	  {
+	    if (!_S_cursor)
+	      _S_cursor = _S_head;
+	    _Sp_collectable_base* __seed = _S_cursor;
+	    _S_cursor = __seed->_M_next;
+	    if (!__index.emplace(__seed, __cand.size()).second)
+	      continue;
+	    __cand.push_back(__seed);
+
+	    for (std::size_t __i = __first.size(); __i < __cand.size(); ++__i)
+	      {
+		__first.push_back(__edges.size());
+		__children.clear();
+		__cand[__i]->_M_children(__children);
+		for (_Base* __c : __children)
+		  {
+		    auto __it = __index.find(__c);
+		    if (__it == __index.end())
+		      {
+			if (__cand.size() >= __budget || !__blocks.count(__c))
+			  continue;
+			__it = __index.emplace(__c, __cand.size()).first;
+			__cand.push_back(static_cast<_Sp_collectable_base*>(__c));
+		      }
+		    __edges.push_back(__it->second);
+		  }
+	      }
+	  }
+	__first.push_back(__edges.size());
+
+	// The references to each candidate from outside the candidates.
+	std::vector<long> __refs(__cand.size());
+	for (std::size_t __i = 0; __i < __cand.size(); ++__i)
+	  __refs[__i] = __cand[__i]->_M_get_use_count();
+	for (std::size_t __e : __edges)
+	  --__refs[__e];
+
+	// Everything reachable from those is live.
+	std::vector<char> __live(__cand.size());
+	std::vector<std::size_t> __work;
+	for (std::size_t __i = 0; __i < __cand.size(); ++__i)
+	  if (__refs[__i] > 0)
+	    {
+	      __live[__i] = true;
+	      __work.push_back(__i);
+	    }
+	while (!__work.empty())
+	  {
+	    std::size_t __i = __work.back();
+	    __work.pop_back();
+	    for (std::size_t __e = __first[__i]; __e != __first[__i + 1]; ++__e)
+	      if (!__live[__edges[__e]])
+		{
+		  __live[__edges[__e]] = true;
+		  __work.push_back(__edges[__e]);
+		}
+	  }
+
+	// Hold a reference to each of the rest, so that none is destroyed
+	// until all of their members into the cycle have been reset.
+	for (std::size_t __i = 0; __i < __cand.size(); ++__i)
+	  if (!__live[__i] && __cand[__i]->_M_add_ref_lock_nothrow())
+	    __garbage.insert(__cand[__i]);
+      }
+
+      // Without the lock, which destroying the objects takes.
+      for (_Base* __b : __garbage)
+	static_cast<_Sp_collectable_base*>(__b)->_M_clear(__garbage);
+      for (_Base* __b : __garbage)
+	__b->_M_release();
+      return __garbage.size();
+    }
+
+    static inline _Sp_collectable_base* _S_head = nullptr;
+    static inline _Sp_collectable_base* _S_cursor = nullptr;
+    static inline std::size_t _S_size = 0;
+  };
+
+  template<typename _Tp>
+    class _Sp_collectable_block final
+    : public std::_Sp_inplace_block<_Sp_collectable_block<_Tp>, _Tp,
+				    _Sp_collectable_base>
+    {
+    public:
+      using std::_Sp_inplace_block<_Sp_collectable_block, _Tp,
+				   _Sp_collectable_base>::_Sp_inplace_block;
+
+    private:
+      void
+      _M_dispose() noexcept override
+      {
+	sp_collector::_S_unregister(this);
+	this->_M_ptr()->~_Tp();
+      }
+
+      void
+      _M_children(std::vector<std::_Sp_counted_base<>*>& __v) override
+      {
+	auto __visit = [&__v](const auto& __sp) {
+	  if (auto* __pi = std::_Sp_block_access::_S_block(__sp))
+	    __v.push_back(__pi);
+	};
+	this->_M_ptr()->sp_visit(__visit);
+      }
+
+      void
+      _M_clear(const _Sp_collectable_base::_Block_set& __s) noexcept override
+      {
+	auto __visit = [&__s](auto& __sp) {
+	  if (auto* __pi = std::_Sp_block_access::_S_block(__sp))
+	    if (__s.count(__pi))
+	      __sp.reset();
+	};
+	this->_M_ptr()->sp_visit(__visit);
+      }
+    };
+
+  /**
+   *  @brief  Create an object whose cycles sp_collector can free.
+   *
+   *  Like `std::make_shared<_Tp>(__args...)`, except that the object is
+   *  tracked by sp_collector. `_Tp` must have a member function template
+   *  `sp_visit(__v)` which calls `__v(__p)` for each shared_ptr member `__p`
+   *  that can be part of a cycle. Members it does not visit are never
+   *  reset by the collector, and keep what they own alive.
+   *
+   *  The object and its count are allocated together, with two more
+   *  pointers for the collector's list.
+   */
+  template<typename _Tp, typename... _Args>
+    std::shared_ptr<_Tp>
+    make_shared_collectable(_Args&&... __args)
+    {
+      static_assert(!std::is_array<_Tp>::value, "not an array type");
+      auto* __b = new _Sp_collectable_block<std::__remove_cv_t<_Tp>>(
+	  std::forward<_Args>(__args)...);
+      std::shared_ptr<_Tp> __sp;
+      std::_Sp_block_access::_S_adopt(__sp, __b->_M_ptr(), __b);
+      sp_collector::_S_register(__b); // If this throws, __sp frees __b.
+      return __sp;
+    }
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+
+#endif
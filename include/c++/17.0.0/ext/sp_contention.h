@@ -0,0 +1,319 @@
+// Sampling profiler for shared_ptr reference count contention -*- C++ -*-
+
+// Copyright (C) 2026 Free Software Foundation, Inc.
+//
+// This file is part of the GNU ISO C++ Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+/** @file ext/sp_contention.h
+ *  This file is a GNU extension to the Standard C++ Library.
+ *
+ *  Requires `_GLIBCXX_SP_INSTRUMENT`, like <ext/sp_instrument.h>.
+ */
+
+#ifndef _SP_CONTENTION_H
+#define _SP_CONTENTION_H 1
+
+#ifdef _GLIBCXX_SYSHDR
+#pragma GCC system_header
+#endif
+
+#include <ext/sp_instrument.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <cxxabi.h>
+
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  /// A control block that was sampled, with how many threads touched it.
+  struct sp_hot_block
+  {
+    const void* control_block;
+    const std::type_info* type;	  // Null without RTTI.
+    std::size_t samples;
+    std::size_t threads;		  // Distinct threads among the samples.
+    unsigned long long first_ns;	  // steady_clock time of the first sample
+    unsigned long long last_ns;	  // and of the last.
+  };
+
+  /**
+   *  @brief  Finds the shared objects whose counts bounce between threads.
+   *
+   *  `install(__n)` installs a hook which records about one in `__n` of the
+   *  `add_ref` and `release` events on each thread: the control block, the
+   *  owned type, the thread and the time. Each thread writes into its own
+   *  ring buffer, without locks, keeping the most recent samples. Events
+   *  are passed on to the hook that was installed before, if any.
+   *
+   *  `top(__n)` aggregates the samples in all buffers by control block and
+   *  returns the `__n` blocks seen from the most threads. A block touched
+   *  by many threads is a candidate for a per-thread copy, a cached
+   *  snapshot or a non-atomic lock policy. Samples are taken while other
+   *  threads keep writing, so a report can include a few torn samples.
+   *  The address of a destroyed control block can be reused by a new one,
+   *  whose samples are then counted with it.
+   */
+  class sp_contention_profiler
+  {
+  public:
+    static void
+    install(unsigned __every = 64) noexcept
+    {
+      _S_period.store(__every ? __every : 1, std::memory_order_relaxed);
+      sp_hook __prev = set_sp_hook(&_S_hook);
+      if (__prev != &_S_hook)
+	_S_next.store(__prev, std::memory_order_release);
+    }
+
+    /// Restore the previous hook, if ours is still the installed one.
+    static void
+    uninstall() noexcept
+    {
+      sp_hook __ours = &_S_hook;
+      if (__atomic_compare_exchange_n(&std::__sp_hook, &__ours,
+				      _S_next.load(std::memory_order_acquire),
+				      false, __ATOMIC_ACQ_REL,
+				      __ATOMIC_RELAXED))
+	_S_next.store(nullptr, std::memory_order_release);
+    }
+
+    /// The @a __n control blocks sampled on the most threads.
+    static std::vector<sp_hot_block>
+    top(std::size_t __n = 10)
+    {
+      struct _Flat { const void* _M_cb; unsigned _M_thread;
+		     const std::type_info* _M_type; unsigned long long _M_time; };
+      std::vector<_Flat> __all;
+      for (_Ring* __r = _S_rings.load(std::memory_order_acquire); __r;
+	   __r = __r->_M_next)
+	{
+	  std::size_t __head = __r->_M_head.load(std::memory_order_acquire);
+	  std::size_t __len = std::min(__head, _S_capacity);
+	  for (std::size_t __i = __head - __len; __i != __head; ++__i)
+	    {
+	      _Sample& __s = __r->_M_samples[__i % _S_capacity];
+	      const void* __cb = __s._M_cb.load(std::memory_order_relaxed);
+	      if (__cb)
+		__all.push_back({__cb,
+				 __s._M_thread.load(std::memory_order_relaxed),
+				 __s._M_type.load(std::memory_order_relaxed),
+				 __s._M_time.load(std::memory_order_relaxed)});
+	    }
+	}
+
+      std::sort(__all.begin(), __all.end(),
+		[](const _Flat& __a, const _Flat& __b) {
+		  return __a._M_cb != __b._M_cb
+		    ? std::less<const void*>()(__a._M_cb, __b._M_cb)
+		    : __a._M_thread < __b._M_thread;
+		});
+
+      std::vector<sp_hot_block> __blocks;
+      for (std::size_t __i = 0; __i < __all.size(); ++__i)
+	{
+	  const _Flat& __f = __all[__i];
+	  if (__blocks.empty() || __blocks.back().control_block != __f._M_cb)
+	    __blocks.push_back({__f._M_cb, __f._M_type, 0, 0,
+				__f._M_time, __f._M_time});
+	  sp_hot_block& __b = __blocks.back();
+	  ++__b.samples;
+	  if (__b.samples == 1 || __all[__i - 1]._M_thread != __f._M_thread)
+	    ++__b.threads;
+	  __b.first_ns = std::min(__b.first_ns, __f._M_time);
+	  __b.last_ns = std::max(__b.last_ns, __f._M_time);
+	}
+
+      auto __hotter = [](const sp_hot_block& __a, const sp_hot_block& __b) {
+	return __a.threads != __b.threads ? __a.threads > __b.threads
+					  : __a.samples > __b.samples;
+      };
+      if (__n < __blocks.size())
+	{
+	  std::partial_sort(__blocks.begin(), __blocks.begin() + __n,
+			    __blocks.end(), __hotter);
+	  __blocks.resize(__n);
+	}
+      else
+	std::sort(__blocks.begin(), __blocks.end(), __hotter);
+      return __blocks;
+    }
+
+    /// Print the report from top(__n) to @a __f.
+    static void
+    print(std::FILE* __f, std::size_t __n = 10)
+    {
+      std::fprintf(__f, "%-18s %8s %8s %12s  %s\n",
+		   "control block", "threads", "samples", "span (us)", "type");
+      for (const sp_hot_block& __b : top(__n))
+	{
+	  const char* __name = __b.type ? __b.type->name() : "?";
+	  int __status;
+	  char* __dem = abi::__cxa_demangle(__name, nullptr, nullptr, &__status);
+	  std::fprintf(__f, "%-18p %8zu %8zu %12.1f  %s\n", __b.control_block,
+		       __b.threads, __b.samples,
+		       (__b.last_ns - __b.first_ns) / 1000.0,
+		       __dem ? __dem : __name);
+	  std::free(__dem);
+	}
+    }
+
+    /// Discard all samples taken so far.
+    static void
+    clear() noexcept
+    {
+      for (_Ring* __r = _S_rings.load(std::memory_order_acquire); __r;
+	   __r = __r->_M_next)
+	for (_Sample& __s : __r->_M_samples)
+	  __s._M_cb.store(nullptr, std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr std::size_t _S_capacity = 4096;
+
+    struct _Sample
+    {
+      std::atomic<const void*> _M_cb;
+      std::atomic<const std::type_info*> _M_type;
+      std::atomic<unsigned> _M_thread;
+      std::atomic<unsigned long long> _M_time;
+    };
+
+    // Written only by the thread that owns it. Rings are never freed; the
+    // ring of a thread that has exited is reused by the next new thread.
+    struct _Ring
+    {
+      _Ring* _M_next = nullptr;
+      std::atomic<bool> _M_in_use{true};
+      std::atomic<std::size_t> _M_head{0};
+      _Sample _M_samples[_S_capacity] = {};
+    };
+
+    // Trivially destructible, so still usable by events that happen while
+    // the thread's other thread_local objects are destroyed.
+    struct _Tls
+    {
+      _Ring* _M_ring;
+      unsigned _M_thread;
+      unsigned _M_countdown;
+      bool _M_exited;
+    };
+
+    static _Tls&
+    _S_tls() noexcept
+    {
+      static thread_local _Tls __tls{};
+      return __tls;
+    }
+
+    // Hands the ring back when the thread exits.
+    struct _Release
+    {
+      ~_Release()
+      {
+	_Tls& __t = _S_tls();
+	__t._M_ring->_M_in_use.store(false, std::memory_order_release);
+	__t._M_ring = nullptr;
+	__t._M_exited = true;
+      }
+    };
+
+    static _Ring*
+    _S_claim() noexcept
+    {
+      _Ring* __r = _S_rings.load(std::memory_order_acquire);
+      for (; __r; __r = __r->_M_next)
+	{
+	  bool __free = false;
+	  if (__r->_M_in_use.compare_exchange_strong(__free, true,
+						std::memory_order_acquire))
+	    break;
+	}
+      if (!__r)
+	{
+	  __r = new (std::nothrow) _Ring;
+	  if (!__r)
+	    return nullptr;
+	  __r->_M_next = _S_rings.load(std::memory_order_relaxed);
+	  while (!_S_rings.compare_exchange_weak(__r->_M_next, __r,
+						 std::memory_order_release,
+						 std::memory_order_relaxed))
+	    { }
+	}
+      static thread_local _Release __release;
+      (void) __release;
+      return __r;
+    }
+
+    static void
+    _S_sample(const void* __cb, const std::type_info* __ti) noexcept
+    {
+      _Tls& __t = _S_tls();
+      if (__t._M_countdown != 0)
+	{
+	  --__t._M_countdown;
+	  return;
+	}
+      __t._M_countdown = _S_period.load(std::memory_order_relaxed) - 1;
+      if (__t._M_exited)
+	return;
+      if (!__t._M_ring)
+	{
+	  if (!(__t._M_ring = _S_claim()))
+	    return;
+	  __t._M_thread = _S_threads.fetch_add(1, std::memory_order_relaxed);
+	}
+
+      std::chrono::nanoseconds __now
+	= std::chrono::steady_clock::now().time_since_epoch();
+      _Ring& __r = *__t._M_ring;
+      std::size_t __head = __r._M_head.load(std::memory_order_relaxed);
+      _Sample& __s = __r._M_samples[__head % _S_capacity];
+      __s._M_cb.store(__cb, std::memory_order_relaxed);
+      __s._M_type.store(__ti, std::memory_order_relaxed);
+      __s._M_thread.store(__t._M_thread, std::memory_order_relaxed);
+      __s._M_time.store(__now.count(), std::memory_order_relaxed);
+      __r._M_head.store(__head + 1, std::memory_order_release);
+    }
+
+    static void
+    _S_hook(sp_event __e, const void* __cb, const std::type_info* __ti,
+	    std::size_t __bytes) noexcept
+    {
+      if (__e == sp_event::_S_add_ref || __e == sp_event::_S_release)
+	_S_sample(__cb, __ti);
+      if (sp_hook __next = _S_next.load(std::memory_order_relaxed))
+	__next(__e, __cb, __ti, __bytes);
+    }
+
+    static inline std::atomic<unsigned> _S_period{64};
+    static inline std::atomic<unsigned> _S_threads{0};
+    static inline std::atomic<sp_hook> _S_next{nullptr};
+    static inline std::atomic<_Ring*> _S_rings{nullptr};
+  };
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+
+#endif
@@ -0,0 +1,352 @@
+// Deferred destruction of shared objects -*- C++ -*-
+
+// Copyright (C) 2026 Free Software Foundation, Inc.
+//
+// This file is part of the GNU ISO C++ Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+/** @file ext/sp_deferred.h
+ *  This file is a GNU extension to the Standard C++ Library.
+ */
+
+#ifndef _SP_DEFERRED_H
+#define _SP_DEFERRED_H 1
+
+#ifdef _GLIBCXX_SYSHDR
+#pragma GCC system_header
+#endif
+
+#include <bits/requires_hosted.h> // std::shared_ptr, std::thread
+
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  /// Counters for sp_deferred_queue.
+  struct sp_deferred_stats
+  {
+    std::size_t pending;	    // Objects waiting to be destroyed.
+    unsigned long long enqueued;    // Objects queued so far.
+    unsigned long long reclaimed;   // Objects destroyed so far.
+    unsigned long long busy_ns;	    // Time spent destroying them.
+  };
+
+  class sp_deferred_queue;
+
+  // A link in the queue.
+  struct _Sp_deferred_node
+  {
+    std::atomic<_Sp_deferred_node*> _M_next{nullptr};
+  };
+
+  // The control block of an object created by make_shared_deferred.
+  class _Sp_deferred_base
+  : public std::_Sp_counted_base<>, private _Sp_deferred_node
+  {
+  public:
+    // Called when the last shared_ptr goes: leave the object for the queue.
+    void
+    _M_dispose() noexcept override;
+
+    // Called when the weak count drops to zero. The block is freed by
+    // whichever comes last of this and the destruction of the object.
+    void
+    _M_destroy() noexcept override
+    {
+      if (_M_state.fetch_or(_S_destroy_requested, std::memory_order_acq_rel)
+	    & _S_disposed)
+	_M_free();
+    }
+
+  protected:
+    // Destroy the object.
+    virtual void
+    _M_reclaim() noexcept = 0;
+
+    // Free the block.
+    virtual void
+    _M_free() noexcept = 0;
+
+  private:
+    friend class sp_deferred_queue;
+
+    enum : unsigned char { _S_disposed = 1, _S_destroy_requested = 2 };
+
+    std::atomic<unsigned char> _M_state{0};
+  };
+
+  /**
+   *  @brief  The objects created by make_shared_deferred that are waiting
+   *          to be destroyed.
+   *
+   *  When the last shared_ptr to such an object is destroyed or reset, its
+   *  control block is pushed onto this queue instead of the object being
+   *  destroyed there and then. A push is an exchange and a store, without
+   *  locks or allocation, whichever thread does it. The object, and then
+   *  the control block once no weak_ptr refers to it, are destroyed by the
+   *  next call to `drain()`, or by the reclaimer thread started by
+   *  `start_reclaimer()`. weak_ptrs to an object in the queue have already
+   *  expired.
+   *
+   *  Objects still queued when the program exits are destroyed then.
+   */
+  class sp_deferred_queue
+  {
+  public:
+    /// Destroy up to @a __max queued objects. Returns how many it did.
+    static std::size_t
+    drain(std::size_t __max = std::size_t(-1)) noexcept
+    {
+      std::lock_guard<std::mutex> __l(_S_consumer_mx());
+      auto __start = std::chrono::steady_clock::now();
+      std::size_t __n = 0;
+      while (__n < __max)
+	{
+	  _Sp_deferred_node* __node = _S_pop();
+	  if (!__node)
+	    break;
+	  auto* __b = static_cast<_Sp_deferred_base*>(__node);
+	  __b->_M_reclaim();
+	  if (__b->_M_state.fetch_or(_Sp_deferred_base::_S_disposed,
+				     std::memory_order_acq_rel)
+		& _Sp_deferred_base::_S_destroy_requested)
+	    __b->_M_free();
+	  ++__n;
+	}
+      if (__n)
+	{
+	  std::chrono::nanoseconds __t = std::chrono::steady_clock::now()
+					   - __start;
+	  _S_busy_ns.fetch_add(__t.count(), std::memory_order_relaxed);
+	  _S_reclaimed.fetch_add(__n, std::memory_order_release);
+	}
+      return __n;
+    }
+
+    /// Start a thread which calls drain() every @a __period, if it is not
+    /// already running.
+    static void
+    start_reclaimer(std::chrono::nanoseconds __period
+		      = std::chrono::milliseconds(1))
+    {
+      _Reclaimer& __r = _S_reclaimer();
+      std::lock_guard<std::mutex> __l(__r._M_mx);
+      if (__r._M_thread.joinable())
+	return;
+      __r._M_stop = false;
+      __r._M_thread = std::thread([&__r, __period] {
+	std::unique_lock<std::mutex> __l(__r._M_mx);
+	while (!__r._M_stop)
+	  {
+	    __l.unlock();
+	    drain();
+	    __l.lock();
+	    __r._M_cv.wait_for(__l, __period, [&__r] { return __r._M_stop; });
+	  }
+      });
+    }
+
+    /// Stop the reclaimer thread, after it destroys what is queued.
+    static void
+    stop_reclaimer()
+    {
+      _Reclaimer& __r = _S_reclaimer();
+      std::thread __t;
+      {
+	std::lock_guard<std::mutex> __l(__r._M_mx);
+	__r._M_stop = true;
+	__t = std::move(__r._M_thread);
+      }
+      __r._M_cv.notify_all();
+      if (__t.joinable())
+	__t.join();
+      drain();
+    }
+
+    /// The queue depth and the totals so far. Dividing `reclaimed` by
+    /// `busy_ns` gives the drain rate.
+    static sp_deferred_stats
+    stats() noexcept
+    {
+      auto __done = _S_reclaimed.load(std::memory_order_acquire);
+      auto __queued = _S_enqueued.load(std::memory_order_acquire);
+      return { std::size_t(__queued - __done), __queued, __done,
+	       _S_busy_ns.load(std::memory_order_relaxed) };
+    }
+
+  private:
+    friend class _Sp_deferred_base;
+    template<typename _Tp, typename... _Args>
+      friend std::shared_ptr<_Tp>
+      make_shared_deferred(_Args&&...);
+
+    struct _Reclaimer
+    {
+      std::mutex _M_mx;
+      std::condition_variable _M_cv;
+      std::thread _M_thread;
+      bool _M_stop = false;
+
+      ~_Reclaimer()
+      {
+	if (_M_thread.joinable())
+	  {
+	    {
+	      std::lock_guard<std::mutex> __l(_M_mx);
+	      _M_stop = true;
+	    }
+	    _M_cv.notify_all();
+	    _M_thread.join();
+	  }
+	drain();
+      }
+    };
+
+    // Also makes sure that what is queued at exit is destroyed.
+    static _Reclaimer&
+    _S_reclaimer()
+    {
+      _S_consumer_mx(); // Constructed first, so destroyed after __r.
+      static _Reclaimer __r;
+      return __r;
+    }
+
+    static std::mutex&
+    _S_consumer_mx() noexcept
+    {
+      static std::mutex __mx;
+      return __mx;
+    }
+
+    // An intrusive multi-producer single-consumer queue (D. Vyukov's).
+    // Producers swap themselves in at _S_head and then link the previous
+    // head to themselves; the consumer, holding _S_consumer_mx, follows
+    // the links from _S_tail.
+    static void
+    _S_push(_Sp_deferred_node* __n) noexcept
+    {
+      __n->_M_next.store(nullptr, std::memory_order_relaxed);
+      _Sp_deferred_node* __prev
+	= _S_head.exchange(__n, std::memory_order_acq_rel);
+      __prev->_M_next.store(__n, std::memory_order_release);
+    }
+
+    // Null if the queue is empty, or if the next node is still being
+    // linked in by a producer, which the next drain() will then find.
+    static _Sp_deferred_node*
+    _S_pop() noexcept
+    {
+      _Sp_deferred_node* __tail = _S_tail;
+      _Sp_deferred_node* __next = __tail->_M_next.load(std::memory_order_acquire);
+      if (__tail == &_S_stub)
+	{
+	  if (!__next)
+	    return nullptr;
+	  _S_tail = __tail = __next;
+	  __next = __tail->_M_next.load(std::memory_order_acquire);
+	}
+      if (__next)
+	{
+	  _S_tail = __next;
+	  return __tail;
+	}
+      if (__tail != _S_head.load(std::memory_order_acquire))
+	return nullptr;
+      // __tail is the last node: put the stub behind it, so that it can be
+      // taken without leaving the queue without a head.
+      _S_push(&_S_stub);
+      __next = __tail->_M_next.load(std::memory_order_acquire);
+      if (__next)
+	{
+	  _S_tail = __next;
+	  return __tail;
+	}
+      return nullptr;
+    }
+
+    static inline _Sp_deferred_node _S_stub;
+    static inline std::atomic<_Sp_deferred_node*> _S_head{&_S_stub};
+    static inline _Sp_deferred_node* _S_tail = &_S_stub;
+    static inline std::atomic<unsigned long long> _S_enqueued{0};
+    static inline std::atomic<unsigned long long> _S_reclaimed{0};
+    static inline std::atomic<unsigned long long> _S_busy_ns{0};
+  };
+
+  inline void
+  _Sp_deferred_base::_M_dispose() noexcept
+  {
+    sp_deferred_queue::_S_enqueued.fetch_add(1, std::memory_order_relaxed);
+    sp_deferred_queue::_S_push(this);
+  }
+
+  template<typename _Tp>
+    class _Sp_deferred_block final
+    : public std::_Sp_inplace_block<_Sp_deferred_block<_Tp>, _Tp,
+				    _Sp_deferred_base>
+    {
+    public:
+      using std::_Sp_inplace_block<_Sp_deferred_block, _Tp,
+				   _Sp_deferred_base>::_Sp_inplace_block;
+
+    private:
+      void
+      _M_reclaim() noexcept override
+      { this->_M_ptr()->~_Tp(); }
+
+      void
+      _M_free() noexcept override
+      { delete this; }
+    };
+
+  /**
+   *  @brief  Create an object that is destroyed by sp_deferred_queue.
+   *
+   *  Like `std::make_shared<_Tp>(__args...)`, except that when the last
+   *  shared_ptr to the object goes, the object is queued for destruction
+   *  instead of being destroyed by the thread that released it. Use it for
+   *  objects whose destructor is too slow to run on that thread.
+   *
+   *  The object and its count are allocated together, with a pointer and
+   *  a byte more for the queue.
+   */
+  template<typename _Tp, typename... _Args>
+    std::shared_ptr<_Tp>
+    make_shared_deferred(_Args&&... __args)
+    {
+      static_assert(!std::is_array<_Tp>::value, "not an array type");
+      auto* __b = new _Sp_deferred_block<std::__remove_cv_t<_Tp>>(
+	  std::forward<_Args>(__args)...);
+      std::shared_ptr<_Tp> __sp;
+      std::_Sp_block_access::_S_adopt(__sp, __b->_M_ptr(), __b);
+      sp_deferred_queue::_S_reclaimer();
+      return __sp;
+    }
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+
+#endif
@@ -0,0 +1,284 @@
+// Flattening of compile-time shared_ptr graphs into tables -*- C++ -*-
+
+// Copyright (C) 2026 Free Software Foundation, Inc.
+//
+// This file is part of the GNU ISO C++ Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+/** @file ext/sp_flatten.h
+ *  This file is a GNU extension to the Standard C++ Library.
+ */
+
+#ifndef _SP_FLATTEN_H
+#define _SP_FLATTEN_H 1
+
+#ifdef _GLIBCXX_SYSHDR
+#pragma GCC system_header
+#endif
+
+#include <bits/requires_hosted.h> // std::vector, std::shared_ptr
+
+#include <memory>
+
+#if __glibcxx_constexpr_memory >= 202506L && __cpp_consteval
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  /// The index of a null shared_ptr in an sp_flat_graph.
+  inline constexpr std::uint32_t sp_flat_null = std::uint32_t(-1);
+
+  /// A node of an sp_flat_graph: its data and where its links are.
+  template<typename _Data>
+    struct sp_flat_node
+    {
+      _Data data;
+      std::uint32_t first_link;	  // In sp_flat_graph::links.
+      std::uint32_t link_count;
+    };
+
+  /// A read-only view of the nodes of an sp_flat_graph.
+  template<typename _Data>
+    class sp_flat_view
+    {
+    public:
+      /// A node, or no node for a null link.
+      class node_ref
+      {
+      public:
+	constexpr node_ref() noexcept = default;
+
+	constexpr explicit operator bool() const noexcept
+	{ return _M_i != sp_flat_null; }
+
+	/// The position of the node in the graph; sp_flat_null if none.
+	constexpr std::uint32_t
+	index() const noexcept
+	{ return _M_i; }
+
+	constexpr const _Data&
+	operator*() const noexcept
+	{ return _M_nodes[_M_i].data; }
+
+	constexpr const _Data*
+	operator->() const noexcept
+	{ return &_M_nodes[_M_i].data; }
+
+	/// The number of shared_ptr members, null or not, that the node had.
+	constexpr std::size_t
+	size() const noexcept
+	{ return _M_nodes[_M_i].link_count; }
+
+	/// The node that the @a __n th shared_ptr member referred to.
+	constexpr node_ref
+	operator[](std::size_t __n) const noexcept
+	{
+	  __glibcxx_assert(__n < size());
+	  return {_M_nodes, _M_links, _M_links[_M_nodes[_M_i].first_link + __n]};
+	}
+
+	friend constexpr bool
+	operator==(node_ref __a, node_ref __b) noexcept
+	{ return __a._M_i == __b._M_i; }
+
+      private:
+	friend sp_flat_view;
+
+	constexpr
+	node_ref(const sp_flat_node<_Data>* __nodes,
+		 const std::uint32_t* __links, std::uint32_t __i) noexcept
+	: _M_nodes(__nodes), _M_links(__links), _M_i(__i)
+	{ }
+
+	const sp_flat_node<_Data>* _M_nodes = nullptr;
+	const std::uint32_t* _M_links = nullptr;
+	std::uint32_t _M_i = sp_flat_null;
+      };
+
+      constexpr
+      sp_flat_view(const sp_flat_node<_Data>* __nodes, std::size_t __n,
+		   const std::uint32_t* __links) noexcept
+      : _M_nodes(__nodes), _M_size(__n), _M_links(__links)
+      { }
+
+      constexpr std::size_t
+      size() const noexcept
+      { return _M_size; }
+
+      constexpr node_ref
+      operator[](std::size_t __i) const noexcept
+      {
+	__glibcxx_assert(__i < _M_size);
+	return {_M_nodes, _M_links, std::uint32_t(__i)};
+      }
+
+      /// The node that the root shared_ptr referred to, if not null.
+      constexpr node_ref
+      root() const noexcept
+      {
+	return _M_size ? (*this)[0] : node_ref();
+      }
+
+    private:
+      const sp_flat_node<_Data>* _M_nodes;
+      std::size_t _M_size;
+      const std::uint32_t* _M_links;
+    };
+
+  /// The table made by sp_flatten. Node 0 is the root.
+  template<typename _Data, std::size_t _Nodes, std::size_t _Links>
+    struct sp_flat_graph
+    {
+      std::array<sp_flat_node<_Data>, _Nodes> nodes;
+      std::array<std::uint32_t, _Links> links;
+
+      constexpr sp_flat_view<_Data>
+      view() const noexcept
+      { return {nodes.data(), _Nodes, links.data()}; }
+    };
+
+  template<typename _Tp>
+    struct _Sp_flatten
+    {
+      // The distinct objects of the graph, in breadth-first order, and for
+      // each the indices of the objects that its shared_ptr members refer
+      // to, all concatenated.
+      struct _Walk
+      {
+	std::vector<std::shared_ptr<_Tp>> _M_nodes;
+	std::vector<std::uint32_t> _M_first;
+	std::vector<std::uint32_t> _M_links;
+      };
+
+      // Equal objects are those with the same owner and address. The
+      // addresses of different allocations cannot be ordered during
+      // constant evaluation, so the search is linear.
+      static constexpr std::uint32_t
+      _S_find(const _Walk& __w, const std::shared_ptr<_Tp>& __p)
+      {
+	for (std::size_t __i = 0; __i < __w._M_nodes.size(); ++__i)
+	  if (__w._M_nodes[__i].owner_equal(__p)
+		&& __w._M_nodes[__i].get() == __p.get())
+	    return __i;
+	return sp_flat_null;
+      }
+
+      static constexpr _Walk
+      _S_walk(std::shared_ptr<_Tp> __root)
+      {
+	_Walk __w;
+	if (__root)
+	  __w._M_nodes.push_back(std::move(__root));
+	for (std::size_t __i = 0; __i < __w._M_nodes.size(); ++__i)
+	  {
+	    __w._M_first.push_back(__w._M_links.size());
+	    std::shared_ptr<_Tp> __cur = __w._M_nodes[__i];
+	    auto __visit = [&__w](auto& __sp) {
+	      static_assert(std::is_same<std::__remove_cvref_t<decltype(*__sp)>,
+					 std::__remove_cv_t<_Tp>>::value,
+			    "all nodes have the same type");
+	      std::uint32_t __j = sp_flat_null;
+	      if (__sp)
+		{
+		  std::shared_ptr<_Tp> __p = __sp;
+		  __j = _S_find(__w, __p);
+		  if (__j == sp_flat_null)
+		    {
+		      __j = __w._M_nodes.size();
+		      __w._M_nodes.push_back(std::move(__p));
+		    }
+		}
+	      __w._M_links.push_back(__j);
+	    };
+	    __cur->sp_visit(__visit);
+	  }
+	__w._M_first.push_back(__w._M_links.size());
+	return __w;
+      }
+
+      struct _Sizes
+      {
+	std::size_t _M_nodes;
+	std::size_t _M_links;
+      };
+
+      static constexpr _Sizes
+      _S_sizes(std::shared_ptr<_Tp> __root)
+      {
+	_Walk __w = _S_walk(std::move(__root));
+	return { __w._M_nodes.size(), __w._M_links.size() };
+      }
+    };
+
+  /**
+   *  @brief  Copy a graph of objects built with shared_ptr at compile time
+   *          into a table that can be kept until run time.
+   *
+   *  Memory allocated during constant evaluation must be freed before it
+   *  ends, so a graph of `shared_ptr`s built by a constexpr function cannot
+   *  itself be a constinit variable. `sp_flatten<__make, __project>()` calls
+   *  `__make()` for the root, a `shared_ptr<_Tp>`, and walks the graph. Each
+   *  distinct object becomes a node holding `__project(__obj)`, and each of
+   *  its shared_ptr members an index of a node (or sp_flat_null). An object
+   *  that several shared_ptrs refer to becomes one node.
+   *
+   *  `_Tp` must have a member function template `sp_visit(__v)` which calls
+   *  `__v(__p)` on each shared_ptr member `__p`, all of them to `_Tp`. The
+   *  result of `__project` must be default constructible and usable in a
+   *  constant expression, so without pointers into the graph.
+   *
+   *  @code
+   *    constinit const auto __table = sp_flatten<make_routes, route_info>();
+   *    auto __root = __table.view().root();
+   *  @endcode
+   *
+   *  Finding shared objects takes time quadratic in the number of nodes.
+   */
+  template<auto __make, auto __project>
+    consteval auto
+    sp_flatten()
+    {
+      using _Ptr = decltype(__make());
+      using _Tp = typename _Ptr::element_type;
+      using _Data = std::__remove_cvref_t<decltype(__project(
+		      std::declval<const _Tp&>()))>;
+      constexpr auto __sizes = _Sp_flatten<_Tp>::_S_sizes(__make());
+
+      auto __w = _Sp_flatten<_Tp>::_S_walk(__make());
+      sp_flat_graph<_Data, __sizes._M_nodes, __sizes._M_links> __g{};
+      for (std::size_t __i = 0; __i < __sizes._M_nodes; ++__i)
+	__g.nodes[__i] = { __project(*__w._M_nodes[__i]),
+			   __w._M_first[__i],
+			   __w._M_first[__i + 1] - __w._M_first[__i] };
+      for (std::size_t __i = 0; __i < __sizes._M_links; ++__i)
+	__g.links[__i] = __w._M_links[__i];
+      return __g;
+    }
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+
+#endif // __glibcxx_constexpr_memory
+#endif
@@ -0,0 +1,248 @@
+// Instrumentation hooks for shared_ptr control blocks -*- C++ -*-
+
+// Copyright (C) 2026 Free Software Foundation, Inc.
+//
+// This file is part of the GNU ISO C++ Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+/** @file ext/sp_instrument.h
+ *  This file is a GNU extension to the Standard C++ Library.
+ *
+ *  Requires `_GLIBCXX_SP_INSTRUMENT` to be defined, in every translation
+ *  unit of the program, before any standard header is included.
+ */
+
+#ifndef _SP_INSTRUMENT_H
+#define _SP_INSTRUMENT_H 1
+
+#ifdef _GLIBCXX_SYSHDR
+#pragma GCC system_header
+#endif
+
+#include <bits/requires_hosted.h> // std::shared_ptr, std::vector
+
+#ifndef _GLIBCXX_SP_INSTRUMENT
+# error "<ext/sp_instrument.h> requires _GLIBCXX_SP_INSTRUMENT to be defined"
+#endif
+
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <typeinfo>
+
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  /// Events reported by control blocks. See std::_Sp_event.
+  using sp_event = std::_Sp_event;
+
+  /**
+   *  A function called for every event on every control block, with the
+   *  event, the control block, the type of the owned object (null without
+   *  RTTI) and the size of the control block's allocation. It is called on
+   *  the thread that caused the event, so must be thread-safe, and must not
+   *  create or destroy a shared_ptr itself.
+   */
+  using sp_hook = std::_Sp_hook;
+
+  /// Install @a __h (or nothing, if null) and return the previous hook.
+  inline sp_hook
+  set_sp_hook(sp_hook __h) noexcept
+  { return __atomic_exchange_n(&std::__sp_hook, __h, __ATOMIC_ACQ_REL); }
+
+  /// The installed hook, or null.
+  inline sp_hook
+  get_sp_hook() noexcept
+  { return __atomic_load_n(&std::__sp_hook, __ATOMIC_ACQUIRE); }
+
+  /// Counters for the control blocks of one owned type.
+  struct sp_type_stats
+  {
+    const std::type_info* type;	  // Null for blocks without a known type.
+    unsigned long long created;	  // Control blocks constructed.
+    unsigned long long live;	  // Control blocks not yet destroyed.
+    unsigned long long bytes;	  // Bytes allocated for control blocks.
+    unsigned long long live_bytes;  // Bytes of the live control blocks.
+    unsigned long long add_refs;
+    unsigned long long releases;
+    unsigned long long weak_add_refs;
+    unsigned long long weak_releases;
+    unsigned long long disposed;	  // Owned objects destroyed.
+  };
+
+  /**
+   *  @brief  A hook which keeps counters per owned type.
+   *
+   *  `sp_counters::install()` makes `sp_counters::hook` the installed hook.
+   *  Every event then costs a relaxed atomic increment of a counter shared
+   *  by all control blocks of the same type, so this is meant for finding
+   *  refcount-heavy code, not for leaving on in contended code.
+   *
+   *  Up to 1023 distinct types are counted separately; blocks of any
+   *  further types, and blocks without RTTI, are counted together under a
+   *  null type.
+   */
+  class sp_counters
+  {
+  public:
+    static void
+    install() noexcept
+    { set_sp_hook(&hook); }
+
+    static void
+    hook(sp_event __e, const void*, const std::type_info* __ti,
+	 std::size_t __bytes) noexcept
+    {
+      _Slot& __s = _S_slot(__ti);
+      switch (__e)
+	{
+	case sp_event::_S_create:
+	  _S_inc(__s._M_created);
+	  _S_inc(__s._M_bytes, __bytes);
+	  break;
+	case sp_event::_S_destroy:
+	  _S_inc(__s._M_destroyed);
+	  _S_inc(__s._M_freed_bytes, __bytes);
+	  break;
+	case sp_event::_S_add_ref:
+	  _S_inc(__s._M_add_refs);
+	  break;
+	case sp_event::_S_release:
+	  _S_inc(__s._M_releases);
+	  break;
+	case sp_event::_S_weak_add_ref:
+	  _S_inc(__s._M_weak_add_refs);
+	  break;
+	case sp_event::_S_weak_release:
+	  _S_inc(__s._M_weak_releases);
+	  break;
+	case sp_event::_S_dispose:
+	  _S_inc(__s._M_disposed);
+	  break;
+	}
+    }
+
+    /// The counters for every type seen so far.
+    static std::vector<sp_type_stats>
+    snapshot()
+    {
+      std::vector<sp_type_stats> __v;
+      for (std::size_t __i = 0; __i < _S_size; ++__i)
+	{
+	  _Slot& __s = _S_table()[__i];
+	  const std::type_info* __ti = __s._M_type.load(std::memory_order_acquire);
+	  if (__ti || (__i == 0 && _S_load(__s._M_created)))
+	    {
+	      __v.push_back({__ti});
+	      _S_add(__v.back(), __s);
+	    }
+	}
+      return __v;
+    }
+
+    /// The counters for type @a __ti (all zero if it has not been seen).
+    static sp_type_stats
+    get(const std::type_info& __ti) noexcept
+    {
+      sp_type_stats __r{&__ti};
+      // The same type can have several type_info objects, in different
+      // shared objects, and so several slots.
+      for (std::size_t __i = 1; __i < _S_size; ++__i)
+	{
+	  _Slot& __s = _S_table()[__i];
+	  const std::type_info* __t = __s._M_type.load(std::memory_order_acquire);
+	  if (__t && *__t == __ti)
+	    _S_add(__r, __s);
+	}
+      return __r;
+    }
+
+  private:
+    using _Counter = std::atomic<unsigned long long>;
+
+    struct _Slot
+    {
+      std::atomic<const std::type_info*> _M_type;
+      _Counter _M_created, _M_destroyed, _M_bytes, _M_freed_bytes;
+      _Counter _M_add_refs, _M_releases, _M_weak_add_refs, _M_weak_releases;
+      _Counter _M_disposed;
+    };
+
+    static constexpr std::size_t _S_size = 1024; // Slot 0 is for no type.
+
+    static _Slot*
+    _S_table() noexcept
+    {
+      static _Slot __table[_S_size]; // Zeroed, and constant-initialized.
+      return __table;
+    }
+
+    static void
+    _S_inc(_Counter& __c, unsigned long long __n = 1) noexcept
+    { __c.fetch_add(__n, std::memory_order_relaxed); }
+
+    static unsigned long long
+    _S_load(const _Counter& __c) noexcept
+    { return __c.load(std::memory_order_relaxed); }
+
+    static void
+    _S_add(sp_type_stats& __r, const _Slot& __s) noexcept
+    {
+      __r.created += _S_load(__s._M_created);
+      __r.live += _S_load(__s._M_created) - _S_load(__s._M_destroyed);
+      __r.bytes += _S_load(__s._M_bytes);
+      __r.live_bytes += _S_load(__s._M_bytes) - _S_load(__s._M_freed_bytes);
+      __r.add_refs += _S_load(__s._M_add_refs);
+      __r.releases += _S_load(__s._M_releases);
+      __r.weak_add_refs += _S_load(__s._M_weak_add_refs);
+      __r.weak_releases += _S_load(__s._M_weak_releases);
+      __r.disposed += _S_load(__s._M_disposed);
+    }
+
+    // The slot for __ti, claiming a free one if need be. Open addressing
+    // on the address of the type_info; slots are never freed.
+    static _Slot&
+    _S_slot(const std::type_info* __ti) noexcept
+    {
+      _Slot* __table = _S_table();
+      if (!__ti)
+	return __table[0];
+      std::size_t __h = std::__sp_hash_address(__ti);
+      for (std::size_t __n = 1; __n < _S_size; ++__n, ++__h)
+	{
+	  _Slot& __s = __table[1 + __h % (_S_size - 1)];
+	  const std::type_info* __t = __s._M_type.load(std::memory_order_acquire);
+	  if (__t == __ti)
+	    return __s;
+	  if (!__t && __s._M_type.compare_exchange_strong(__t, __ti,
+						std::memory_order_acq_rel))
+	    return __s;
+	  if (__t == __ti) // Another thread claimed it for the same type.
+	    return __s;
+	}
+      return __table[0]; // Full.
+    }
+  };
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+
+#endif
@@ -0,0 +1,266 @@
+// Recycling of shared objects -*- C++ -*-
+
+// Copyright (C) 2026 Free Software Foundation, Inc.
+//
+// This file is part of the GNU ISO C++ Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+/** @file ext/sp_pool.h
+ *  This file is a GNU extension to the Standard C++ Library.
+ */
+
+#ifndef _SP_POOL_H
+#define _SP_POOL_H 1
+
+#ifdef _GLIBCXX_SYSHDR
+#pragma GCC system_header
+#endif
+
+#include <bits/requires_hosted.h> // std::shared_ptr
+
+#if __cplusplus > 201703L
+
+#include <memory>
+#include <atomic>
+
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  /// Counters for sp_pool.
+  struct sp_pool_stats
+  {
+    unsigned long long hits;	    // Objects reused by acquire().
+    unsigned long long misses;	    // Objects constructed by acquire().
+    unsigned long long recycled;    // Objects put back in a free list.
+    unsigned long long discarded;   // Objects destroyed, a free list being full.
+  };
+
+  template<typename _Tp>
+    class sp_pool;
+
+  // The control block of an object created by sp_pool. It lives as long
+  // as the object, from one use to the next.
+  template<typename _Tp>
+    class _Sp_pooled_block final
+    : public std::_Sp_inplace_block<_Sp_pooled_block<_Tp>, _Tp>
+    {
+    public:
+      using std::_Sp_inplace_block<_Sp_pooled_block, _Tp>::_Sp_inplace_block;
+
+    private:
+      friend class sp_pool<_Tp>;
+
+      // Called when the last shared_ptr goes. weak_ptrs have expired, so
+      // the object can be reset now, while it is likely in the cache. The
+      // weak_ptr of an enable_shared_from_this base is emptied too, or its
+      // weak reference to this block would keep it out of the free list.
+      void
+      _M_dispose() noexcept override
+      {
+	std::_Sp_block_access::_S_forget_owner(this->_M_ptr());
+	this->_M_ptr()->reset();
+      }
+
+      // Called when the weak count drops to zero.
+      void
+      _M_destroy() noexcept override
+      { sp_pool<_Tp>::_S_put(this); }
+
+      void
+      _M_delete() noexcept
+      {
+	this->_M_ptr()->~_Tp();
+	delete this;
+      }
+
+      _Sp_pooled_block* _M_next = nullptr;  // In the free list.
+    };
+
+  /**
+   *  @brief  Free lists of objects of type @a _Tp that are reused instead
+   *          of being destroyed.
+   *
+   *  `acquire(__args...)` returns a shared_ptr to an object from the free
+   *  list of the calling thread, or to a new `_Tp(__args...)` if the list is
+   *  empty. When the last shared_ptr to it goes, `__obj.reset()` is called,
+   *  which must not throw, and must leave the object ready for its next
+   *  user, keeping whatever it is expensive to make (such as the capacity
+   *  of a buffer). Once no weak_ptr refers to it either, the object and its
+   *  control block are put back in the free list of the thread that
+   *  released them, unless that holds `capacity()` objects already, in
+   *  which case the object is destroyed. If `_Tp` derives from
+   *  enable_shared_from_this, `shared_from_this()` works again once the
+   *  object is reused, and refers to the new owner.
+   *
+   *  The objects left in the free list of a thread are destroyed when it
+   *  exits, and `trim()` destroys them earlier.
+   */
+  template<typename _Tp>
+    class sp_pool
+    {
+      static_assert(!std::is_array<_Tp>::value, "not an array type");
+      static_assert(requires (_Tp& __t) { __t.reset(); },
+		    "the pooled type has a reset() member function");
+
+      using _Block = _Sp_pooled_block<_Tp>;
+
+    public:
+      /// A shared_ptr to a reset object if there is one, else to a new one.
+      template<typename... _Args>
+	static std::shared_ptr<_Tp>
+	acquire(_Args&&... __args)
+	{
+	  _Block* __b = nullptr;
+	  if (!_S_dead)
+	    {
+	      _List& __l = _S_list();
+	      if ((__b = __l._M_head))
+		{
+		  __l._M_head = __b->_M_next;
+		  --__l._M_size;
+		  __b->_M_revive();
+		  _S_hits.fetch_add(1, std::memory_order_relaxed);
+		}
+	    }
+	  if (!__b)
+	    {
+	      __b = new _Block(std::forward<_Args>(__args)...);
+	      _S_misses.fetch_add(1, std::memory_order_relaxed);
+	    }
+	  std::shared_ptr<_Tp> __sp;
+	  std::_Sp_block_access::_S_adopt(__sp, __b->_M_ptr(), __b);
+	  return __sp;
+	}
+
+      /// The most objects that the free list of a thread keeps.
+      static std::size_t
+      capacity() noexcept
+      { return _S_capacity.load(std::memory_order_relaxed); }
+
+      /// Set the most objects that the free list of a thread keeps. Lists
+      /// that are longer shrink as they are next used.
+      static void
+      set_capacity(std::size_t __n) noexcept
+      { _S_capacity.store(__n, std::memory_order_relaxed); }
+
+      /// The number of objects in the free list of this thread.
+      static std::size_t
+      pooled() noexcept
+      { return _S_dead ? 0 : _S_list()._M_size; }
+
+      /// Destroy the objects in the free list of this thread.
+      static void
+      trim() noexcept
+      {
+	if (!_S_dead)
+	  _S_list()._M_clear();
+      }
+
+      /// The totals so far, over all threads.
+      static sp_pool_stats
+      stats() noexcept
+      {
+	return { _S_hits.load(std::memory_order_relaxed),
+		 _S_misses.load(std::memory_order_relaxed),
+		 _S_recycled.load(std::memory_order_relaxed),
+		 _S_discarded.load(std::memory_order_relaxed) };
+      }
+
+    private:
+      friend _Block;
+
+      struct _List
+      {
+	_Block* _M_head = nullptr;
+	std::size_t _M_size = 0;
+
+	void
+	_M_clear() noexcept
+	{
+	  while (_Block* __b = _M_head)
+	    {
+	      _M_head = __b->_M_next;
+	      --_M_size;
+	      __b->_M_delete();
+	    }
+	}
+
+	~_List()
+	{
+	  _M_clear();
+	  _S_dead = true;
+	}
+      };
+
+      static _List&
+      _S_list() noexcept
+      {
+	static thread_local _List __l;
+	return __l;
+      }
+
+      static void
+      _S_put(_Block* __b) noexcept
+      {
+	// Not once the list of the thread is gone, during its exit.
+	if (!_S_dead)
+	  {
+	    _List& __l = _S_list();
+	    std::size_t __cap = capacity();
+	    while (__l._M_size > __cap && __l._M_head)
+	      {
+		_Block* __old = __l._M_head;
+		__l._M_head = __old->_M_next;
+		--__l._M_size;
+		__old->_M_delete();
+	      }
+	    if (__l._M_size < __cap)
+	      {
+		__b->_M_next = __l._M_head;
+		__l._M_head = __b;
+		++__l._M_size;
+		_S_recycled.fetch_add(1, std::memory_order_relaxed);
+		return;
+	      }
+	  }
+	__b->_M_delete();
+	_S_discarded.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      static inline thread_local bool _S_dead = false;
+      static inline std::atomic<std::size_t> _S_capacity{64};
+      static inline std::atomic<unsigned long long> _S_hits{0};
+      static inline std::atomic<unsigned long long> _S_misses{0};
+      static inline std::atomic<unsigned long long> _S_recycled{0};
+      static inline std::atomic<unsigned long long> _S_discarded{0};
+    };
+
+  /// The same as `sp_pool<_Tp>::acquire(__args...)`.
+  template<typename _Tp, typename... _Args>
+    inline std::shared_ptr<_Tp>
+    make_shared_pooled(_Args&&... __args)
+    { return sp_pool<_Tp>::acquire(std::forward<_Args>(__args)...); }
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+
+#endif // C++20
+#endif
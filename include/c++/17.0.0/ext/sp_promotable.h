@@ -0,0 +1,80 @@
+// unique_ptr that becomes shared without allocating -*- C++ -*-
+
+// Copyright (C) 2026 Free Software Foundation, Inc.
+//
+// This file is part of the GNU ISO C++ Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+/** @file ext/sp_promotable.h
+ *  This file is a GNU extension to the Standard C++ Library.
+ */
+
+#ifndef _SP_PROMOTABLE_H
+#define _SP_PROMOTABLE_H 1
+
+#ifdef _GLIBCXX_SYSHDR
+#pragma GCC system_header
+#endif
+
+#include <bits/requires_hosted.h> // std::unique_ptr, std::shared_ptr
+
+#if __cplusplus > 201703L
+
+#include <memory>
+
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  /// The type returned by make_unique_promotable<_Tp>.
+  template<typename _Tp>
+    using unique_promotable_ptr
+      = std::unique_ptr<_Tp, std::_Sp_promotable_delete<_Tp>>;
+
+  /**
+   *  @brief  Create an object owned by a unique_ptr that can be converted
+   *          to shared_ptr without allocating.
+   *
+   *  Like `std::make_unique<_Tp>(__args...)`, except that the allocation
+   *  also has room for a shared_ptr control block. Moving the result into
+   *  a `shared_ptr<_Tp>` (or to a base of `_Tp`) constructs the block there,
+   *  so it cannot fail, and the object and the block are later freed
+   *  together, as with make_shared. `std::get_deleter` finds the deleter
+   *  of the unique_ptr in the shared_ptr too.
+   *
+   *  The unique_ptr is twice the usual size, its deleter pointing to the
+   *  allocation, and the allocation a pointer bigger than make_shared's.
+   *  Usable in constant expressions.
+   */
+  template<typename _Tp, typename... _Args>
+    constexpr unique_promotable_ptr<_Tp>
+    make_unique_promotable(_Args&&... __args)
+    {
+      static_assert(!std::is_array<_Tp>::value, "not an array type");
+      auto* __s = new std::_Sp_promotable_storage<_Tp, __default_lock_policy>(
+	  std::forward<_Args>(__args)...);
+      return unique_promotable_ptr<_Tp>(std::__addressof(__s->_M_obj), {__s});
+    }
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+
+#endif // C++20
+#endif
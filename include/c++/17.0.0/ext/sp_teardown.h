@@ -0,0 +1,174 @@
+// Iterative destruction of shared_ptr chains and trees -*- C++ -*-
+
+// Copyright (C) 2026 Free Software Foundation, Inc.
+//
+// This file is part of the GNU ISO C++ Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+/** @file ext/sp_teardown.h
+ *  This file is a GNU extension to the Standard C++ Library.
+ */
+
+#ifndef _SP_TEARDOWN_H
+#define _SP_TEARDOWN_H 1
+
+#ifdef _GLIBCXX_SYSHDR
+#pragma GCC system_header
+#endif
+
+#include <bits/requires_hosted.h> // std::vector, std::shared_ptr
+
+#if __cplusplus > 201703L
+
+#include <memory>
+#include <vector>
+
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  struct _Sp_teardown
+  {
+    struct _Item;
+    using _Work = std::vector<_Item>;
+
+    // Moves the shared_ptr members of an object of type _Tp to the list.
+    using _Detach = void (*)(const void*, _Work&);
+
+    struct _Item
+    {
+      std::shared_ptr<const void> _M_sp;
+      _Detach _M_detach;  // Null if the type has no sp_visit.
+    };
+
+    struct _Visitor
+    {
+      _Work& _M_work;
+
+      template<typename _Up>
+	constexpr void
+	operator()(std::shared_ptr<_Up>& __sp)
+	{
+	  if (__sp)
+	    _M_work.push_back({std::move(__sp), _S_detacher<_Up>()});
+	}
+    };
+
+    template<typename _Tp>
+      static constexpr _Detach
+      _S_detacher() noexcept
+      {
+	if constexpr (requires (_Tp& __t, _Visitor& __v) { __t.sp_visit(__v); })
+	  return [](const void* __p, _Work& __w) {
+	    _Visitor __v{__w};
+	    static_cast<_Tp*>(const_cast<void*>(__p))->sp_visit(__v);
+	  };
+	else
+	  return nullptr;
+      }
+
+    // Release the shared_ptrs in __w above __base, most recent first. The
+    // shared_ptr members of an object that is about to be destroyed are
+    // moved to __w first, so that destroying it releases nothing.
+    static constexpr void
+    _S_drain(_Work& __w, std::size_t __base)
+    {
+      while (__w.size() > __base)
+	{
+	  _Item __it = std::move(__w.back());
+	  __w.pop_back();
+	  // Not if any weak_ptr could lock it and see it emptied.
+	  if (__it._M_detach
+		&& std::_Sp_block_access::_S_block(__it._M_sp)->_M_sole_owner())
+	    __it._M_detach(__it._M_sp.get(), __w);
+	}
+    }
+
+    // The list for the thread, shared by the nested calls that destroying
+    // the objects in it makes, so that its storage is reused.
+    static _Work&
+    _S_thread_work() noexcept
+    {
+      static thread_local _Work __w;
+      return __w;
+    }
+  };
+
+  /**
+   *  @brief  Release the shared_ptr members of @a __obj without recursion.
+   *
+   *  Destroying the last shared_ptr to the head of a long list destroys
+   *  the next node from within its destructor, and so on, so the depth of
+   *  recursion is the length of the list, which can overflow the stack.
+   *  `sp_teardown(__obj)` instead moves the shared_ptr members of `__obj`
+   *  to a work list, and then repeatedly takes one from the list and, if it
+   *  is the only owner of its object, moves that object's shared_ptr members
+   *  to the list before releasing it. That object's destructor then has no
+   *  shared_ptrs left to release, whatever the depth of the graph.
+   *
+   *  The objects must have a member function template `sp_visit(__v)`
+   *  which calls `__v(__p)` on each shared_ptr member `__p`. Objects which
+   *  do not, or which a weak_ptr refers to (as with enable_shared_from_this),
+   *  are destroyed as usual, with their members.
+   *
+   *  Call it from the destructor of the node type, or use sp_iterative_delete
+   *  as the deleter. The members of `__obj` are destroyed before the rest of
+   *  it. Usable in constant expressions.
+   */
+  template<typename _Tp>
+    constexpr void
+    sp_teardown(_Tp& __obj)
+    {
+      if (std::is_constant_evaluated())
+	{
+	  _Sp_teardown::_Work __w;
+	  _Sp_teardown::_Visitor __v{__w};
+	  __obj.sp_visit(__v);
+	  _Sp_teardown::_S_drain(__w, 0);
+	}
+      else
+	{
+	  _Sp_teardown::_Work& __w = _Sp_teardown::_S_thread_work();
+	  std::size_t __base = __w.size();
+	  _Sp_teardown::_Visitor __v{__w};
+	  __obj.sp_visit(__v);
+	  _Sp_teardown::_S_drain(__w, __base);
+	}
+    }
+
+  /// A deleter that calls sp_teardown on the object before deleting it.
+  template<typename _Tp, typename _Del = std::default_delete<_Tp>>
+    struct sp_iterative_delete
+    {
+      [[__no_unique_address__]] _Del _M_del;
+
+      constexpr void
+      operator()(_Tp* __p)
+      {
+	sp_teardown(*__p);
+	_M_del(__p);
+      }
+    };
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+
+#endif // C++20
+#endif
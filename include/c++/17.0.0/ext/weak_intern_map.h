@@ -0,0 +1,362 @@
+// Concurrent table of weak references -*- C++ -*-
+
+// Copyright (C) 2026 Free Software Foundation, Inc.
+//
+// This file is part of the GNU ISO C++ Library.  This library is free
+// software; you can redistribute it and/or modify it under the
+// terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 3, or (at your option)
+// any later version.
+
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// Under Section 7 of GPL version 3, you are granted additional
+// permissions described in the GCC Runtime Library Exception, version
+// 3.1, as published by the Free Software Foundation.
+
+// You should have received a copy of the GNU General Public License and
+// a copy of the GCC Runtime Library Exception along with this program;
+// see the files COPYING3 and COPYING.RUNTIME respectively.  If not, see
+// <http://www.gnu.org/licenses/>.
+
+/** @file ext/weak_intern_map.h
+ *  This file is a GNU extension to the Standard C++ Library.
+ */
+
+#ifndef _WEAK_INTERN_MAP_H
+#define _WEAK_INTERN_MAP_H 1
+
+#ifdef _GLIBCXX_SYSHDR
+#pragma GCC system_header
+#endif
+
+#include <bits/requires_hosted.h> // std::vector, std::shared_ptr
+
+#if __cplusplus > 201703L
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <ext/numeric_traits.h>
+
+namespace __gnu_cxx _GLIBCXX_VISIBILITY(default)
+{
+_GLIBCXX_BEGIN_NAMESPACE_VERSION
+
+  /**
+   *  @brief  A concurrent map from keys to weakly referenced objects.
+   *
+   *  Maps each key to a `weak_ptr<_Tp>`, so the table never keeps an
+   *  object alive. `find_or_insert` hands out the existing object for a
+   *  key while anyone still owns it, and creates a new one otherwise, so
+   *  equal keys share one instance (interning).
+   *
+   *  The table is split into `_Shards` independently locked shards,
+   *  chosen by hash. Entries whose objects have expired are not swept
+   *  eagerly: they are dropped when a lookup walks over them, or when
+   *  their shard is rehashed, so the cost of cleaning up is spread over
+   *  the operations that touch the same shard.
+   *
+   *  All members are `constexpr` when `shared_ptr` is (C++26), so a map
+   *  can be used during constant evaluation, given a `constexpr` hasher.
+   *
+   *  The factory passed to `find_or_insert` runs with the shard locked,
+   *  and must not use the same map.
+   */
+  template<typename _Key, typename _Tp,
+	   typename _Hash = std::hash<_Key>,
+	   typename _Pred = std::equal_to<_Key>,
+	   std::size_t _Shards = 16>
+    class weak_intern_map
+    {
+      static_assert(_Shards > 0, "weak_intern_map needs at least one shard");
+
+    public:
+      typedef _Key			key_type;
+      typedef _Tp			element_type;
+      typedef _Hash			hasher;
+      typedef _Pred			key_equal;
+      typedef std::size_t		size_type;
+      typedef std::shared_ptr<_Tp>	shared_type;
+
+      constexpr weak_intern_map() = default;
+
+      explicit constexpr
+      weak_intern_map(const _Hash& __hf, const _Pred& __eql = _Pred())
+      : _M_hash(__hf), _M_eq(__eql)
+      { }
+
+      weak_intern_map(const weak_intern_map&) = delete;
+      weak_intern_map& operator=(const weak_intern_map&) = delete;
+
+      /// The live object for @a __k, or an empty pointer.
+      _GLIBCXX26_CONSTEXPR
+      shared_type
+      find(const _Key& __k) const
+      {
+	const size_type __h = _M_hash(__k);
+	_Shard& __s = _M_shard(__h);
+	_Lock __l(__s);
+	return _M_find(__s, __h, __k);
+      }
+
+      /**
+       *  @brief  The live object for @a __k, or a new one from @a __make.
+       *  @param  __k     The key.
+       *  @param  __make  Called as `__make()` to create the object when
+       *                  there is no live one. Must return something
+       *                  convertible to `shared_ptr<_Tp>`.
+       *
+       *  A null result from `__make` is returned as is, and not stored.
+       */
+      template<typename _Fn>
+	_GLIBCXX26_CONSTEXPR
+	shared_type
+	find_or_insert(const _Key& __k, _Fn&& __make)
+	{
+	  const size_type __h = _M_hash(__k);
+	  _Shard& __s = _M_shard(__h);
+	  _Lock __l(__s);
+	  if (shared_type __p = _M_find(__s, __h, __k))
+	    return __p;
+	  shared_type __p = std::forward<_Fn>(__make)();
+	  if (__p)
+	    _M_insert(__s, __h, __k, __p);
+	  return __p;
+	}
+
+      /// Interns @a __p under @a __k, unless a live object is already there.
+      /// Returns whichever object is now current for @a __k.
+      _GLIBCXX26_CONSTEXPR
+      shared_type
+      insert(const _Key& __k, shared_type __p)
+      {
+	return find_or_insert(__k, [&__p] { return std::move(__p); });
+      }
+
+      /// Removes the entry for @a __k. Returns true if it was live.
+      _GLIBCXX26_CONSTEXPR
+      bool
+      erase(const _Key& __k)
+      {
+	const size_type __h = _M_hash(__k);
+	_Shard& __s = _M_shard(__h);
+	_Lock __l(__s);
+	if (__s._M_buckets.empty())
+	  return false;
+	auto& __b = __s._M_buckets[_S_bucket(__h, __s._M_buckets.size())];
+	for (size_type __i = 0; __i < __b.size(); ++__i)
+	  if (__b[__i]._M_hash == __h && _M_eq(__b[__i]._M_key, __k))
+	    {
+	      bool __live = !__b[__i]._M_value.expired();
+	      _S_remove(__s, __b, __i);
+	      return __live;
+	    }
+	return false;
+      }
+
+      /// Drops every expired entry now, rather than lazily.
+      _GLIBCXX26_CONSTEXPR
+      void
+      purge()
+      {
+	for (_Shard& __s : _M_shards)
+	  {
+	    _Lock __l(__s);
+	    for (auto& __b : __s._M_buckets)
+	      for (size_type __i = 0; __i < __b.size();)
+		if (__b[__i]._M_value.expired())
+		  _S_remove(__s, __b, __i);
+		else
+		  ++__i;
+	  }
+      }
+
+      /// The number of entries, counting expired ones not yet purged.
+      _GLIBCXX26_CONSTEXPR
+      size_type
+      size() const
+      {
+	size_type __n = 0;
+	for (_Shard& __s : _M_shards)
+	  {
+	    _Lock __l(__s);
+	    __n += __s._M_size;
+	  }
+	return __n;
+      }
+
+      _GLIBCXX26_CONSTEXPR
+      bool
+      empty() const
+      { return size() == 0; }
+
+      hasher
+      hash_function() const
+      { return _M_hash; }
+
+      key_equal
+      key_eq() const
+      { return _M_eq; }
+
+    private:
+      struct _Entry
+      {
+	_Key			_M_key;
+	std::weak_ptr<_Tp>	_M_value;
+	size_type		_M_hash;
+      };
+
+      using _Bucket = std::vector<_Entry>;
+
+      struct _Shard
+      {
+	std::atomic_flag	_M_lock;
+	std::vector<_Bucket>	_M_buckets;
+	size_type		_M_size = 0;
+      };
+
+      // Scoped spin lock. Shards are small and held only for a probe.
+      struct _Lock
+      {
+	_GLIBCXX26_CONSTEXPR explicit
+	_Lock(_Shard& __s) noexcept
+	: _M_s(__s)
+	{
+	  while (_M_s._M_lock.test_and_set(std::memory_order_acquire))
+#if __glibcxx_atomic_wait
+	    _M_s._M_lock.wait(true, std::memory_order_relaxed);
+#else
+	    ;
+#endif
+	}
+
+	_GLIBCXX26_CONSTEXPR
+	~_Lock()
+	{
+	  _M_s._M_lock.clear(std::memory_order_release);
+#if __glibcxx_atomic_wait
+	  if (!std::__is_constant_evaluated())
+	    _M_s._M_lock.notify_one();
+#endif
+	}
+
+	_Lock(const _Lock&) = delete;
+	_Lock& operator=(const _Lock&) = delete;
+
+	_Shard& _M_s;
+      };
+
+      static constexpr int _S_digits = __int_traits<size_type>::__digits;
+
+      // Spread the hash over all bits, so that neither shard selection
+      // nor bucket masking relies only on the low bits of the hasher's
+      // result (poor for pointers and for std::hash of integers).
+      static constexpr size_type
+      _S_mix(size_type __h) noexcept
+      {
+	__h *= size_type(0x9e3779b97f4a7c15ULL);
+	return __h ^ (__h >> (_S_digits / 2));
+      }
+
+      static constexpr size_type
+      _S_bucket(size_type __h, size_type __nbuckets) noexcept
+      { return (_S_mix(__h) / _Shards) & (__nbuckets - 1); }
+
+      _GLIBCXX26_CONSTEXPR
+      _Shard&
+      _M_shard(size_type __h) const noexcept
+      { return _M_shards[_S_mix(__h) % _Shards]; }
+
+      _GLIBCXX26_CONSTEXPR
+      static void
+      _S_remove(_Shard& __s, _Bucket& __b, size_type __i)
+      {
+	if (__i + 1 != __b.size())
+	  __b[__i] = std::move(__b.back());
+	__b.pop_back();
+	--__s._M_size;
+      }
+
+      // Caller holds the shard lock. Expired entries in the probed bucket
+      // are dropped on the way.
+      _GLIBCXX26_CONSTEXPR
+      shared_type
+      _M_find(_Shard& __s, size_type __h, const _Key& __k) const
+      {
+	if (__s._M_buckets.empty())
+	  return nullptr;
+	auto& __b = __s._M_buckets[_S_bucket(__h, __s._M_buckets.size())];
+	for (size_type __i = 0; __i < __b.size();)
+	  {
+	    _Entry& __e = __b[__i];
+	    if (__e._M_hash == __h && _M_eq(__e._M_key, __k))
+	      {
+		// Keys are unique within a shard, so stop here either way.
+		if (shared_type __p = __e._M_value.lock())
+		  return __p;
+		_S_remove(__s, __b, __i);
+		return nullptr;
+	      }
+	    if (__e._M_value.expired())
+	      _S_remove(__s, __b, __i);
+	    else
+	      ++__i;
+	  }
+	return nullptr;
+      }
+
+      // Caller holds the shard lock and has just failed to find __k.
+      _GLIBCXX26_CONSTEXPR
+      void
+      _M_insert(_Shard& __s, size_type __h, const _Key& __k,
+		const shared_type& __p)
+      {
+	if (__s._M_size >= 2 * __s._M_buckets.size())
+	  _S_rehash(__s);
+	auto& __b = __s._M_buckets[_S_bucket(__h, __s._M_buckets.size())];
+	__b.push_back(_Entry{__k, __p, __h});
+	++__s._M_size;
+      }
+
+      // Drop expired entries, then grow if the shard is still full.
+      _GLIBCXX26_CONSTEXPR
+      static void
+      _S_rehash(_Shard& __s)
+      {
+	size_type __live = 0;
+	for (auto& __b : __s._M_buckets)
+	  for (auto& __e : __b)
+	    __live += !__e._M_value.expired();
+
+	size_type __n = __s._M_buckets.empty() ? 4 : __s._M_buckets.size();
+	while (2 * __n <= __live + 1)
+	  __n *= 2;
+
+	std::vector<_Bucket> __buckets(__n);
+	for (auto& __b : __s._M_buckets)
+	  for (auto& __e : __b)
+	    if (!__e._M_value.expired())
+	      __buckets[_S_bucket(__e._M_hash, __n)].push_back(std::move(__e));
+	__s._M_buckets = std::move(__buckets);
+	__s._M_size = 0;
+	for (auto& __b : __s._M_buckets)
+	  __s._M_size += __b.size();
+      }
+
+      [[no_unique_address]] _Hash		_M_hash;
+      [[no_unique_address]] _Pred		_M_eq;
+      mutable std::array<_Shard, _Shards>	_M_shards{};
+    };
+
+_GLIBCXX_END_NAMESPACE_VERSION
+} // namespace
+
+#endif // C++20
+
+#endif
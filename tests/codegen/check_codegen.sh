@@ -0,0 +1,103 @@
+#!/bin/bash
+
+# Checks that the constexpr headers do not change the runtime code of the
+# functions in corpus.cpp.
+#
+# corpus.cpp is compiled to assembly at -O2, with GCC and Clang, against the
+# headers in this repository and against the unmodified libstdc++ headers
+# (MASTER_INCLUDE, by default those installed with the compiler). Labels,
+# directives and comments are stripped, and the instructions of each cg_*
+# function are compared, as well as the total over every function emitted
+# (which includes out-of-line helpers such as _M_release_last_use_cold).
+#
+# A function fails if its instructions differ from those of the master build
+# at all, unless it is listed in allowed_growth.txt, and then if it grows by
+# more than allowed there. A shrink is no better than growth: it can mean that
+# a fast path has gone. cg_release must also keep the double-word fast path
+# of _M_release() if the master build has it. Set VERBOSE=1 to see the diff
+# of every function that differs, not only of those that fail.
+
+MYINCLUDE="../../include/c++/17.0.0"
+MASTER_INCLUDE="${MASTER_INCLUDE:-/opt/gcc-latest/include/c++/17.0.0}"
+
+MYGCC="/opt/gcc-latest/bin/g++"
+MYCLANG="clang++"
+MYCLANG_NO_WARNINGS="-Wno-unknown-attributes -Wno-ignored-attributes -Wno-deprecated-builtins -Wno-keyword-compat -Wno-inconsistent-missing-override -Wno-user-defined-literals -Wno-unknown-warning-option -Wno-inline-namespace-reopened-noninline -Wno-implicit-exception-spec-mismatch -Wno-gnu-inline-cpp-without-extern -Wno-vla-cxx-extension -Wno-unqualified-std-cast-call"
+FLAGS="-O2 -std=c++26 -pthread -S -fno-asynchronous-unwind-tables -fcf-protection=none -nostdinc++"
+
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+status=0
+
+# Compiles corpus.cpp and writes "function<TAB>instruction" lines.
+# $1 compiler, $2 include directory, $3 output file
+compile() {
+  $1 ${FLAGS} -I "$2" -I "$2/x86_64-pc-linux-gnu" corpus.cpp -o - |
+  awk '
+    /^[A-Za-z_$][A-Za-z0-9_.$]*:/ { fn = substr($1, 1, length($1) - 1); next }
+    /^[ \t]/ {
+      sub(/[ \t]+#.*$/, "")
+      sub(/^[ \t]+/, "")
+      if ($0 == "" || $0 ~ /^\./ || $0 ~ /^#/ || fn == "")
+	next
+      gsub(/\.L[A-Za-z0-9_.$]+/, ".L")
+      gsub(/[ \t]+/, " ")
+      print fn "\t" $0
+    }' > "$3"
+}
+
+# The extra instructions allowed for function $2 with compiler $1, or
+# nothing if it is not listed and must not differ.
+allowed() {
+  awk -v c="$1" -v f="$2" '
+    !/^#/ && NF == 3 && ($1 == c || $1 == "*") && $2 == f { n = $3; found = 1 }
+    END { if (found) print n + 0 }' allowed_growth.txt
+}
+
+# $1 name as used in allowed_growth.txt, $2 compiler
+run() {
+  echo -e "\n        **** << Codegen: master vs constexpr headers ($1) >> ****\n"
+  compile "$2" "${MASTER_INCLUDE}" "$OUT/master" || { status=1; return; }
+  compile "$2" "${MYINCLUDE}" "$OUT/constexpr" || { status=1; return; }
+
+  printf "%-24s %8s %10s %6s\n" function master constexpr change
+  local fns="$(grep -o '^cg_[A-Za-z0-9_]*' "$OUT/master" | sort -u) TOTAL"
+  for fn in ${fns}; do
+    if [ ${fn} = TOTAL ]; then
+      cut -f2 "$OUT/master" > "$OUT/m"
+      cut -f2 "$OUT/constexpr" > "$OUT/c"
+    else
+      awk -F'\t' -v f=${fn} '$1 == f { print $2 }' "$OUT/master" > "$OUT/m"
+      awk -F'\t' -v f=${fn} '$1 == f { print $2 }' "$OUT/constexpr" > "$OUT/c"
+    fi
+    local m=$(wc -l < "$OUT/m") c=$(wc -l < "$OUT/c")
+    local allow=$(allowed $1 ${fn})
+    local note=""
+    if cmp -s "$OUT/m" "$OUT/c"; then
+      :
+    elif [ -z "${allow}" ] || [ $((c - m)) -gt ${allow} ]; then
+      note="  << FAIL"
+      status=1
+    else
+      note="  (allowed)"
+    fi
+    printf "%-24s %8d %10d %+6d%s\n" ${fn} ${m} ${c} $((c - m)) "${note}"
+    if [ "${note}" = "  << FAIL" ] || { [ -n "${note}" ] && [ -n "${VERBOSE}" ]; }
+    then
+      diff -u --label master --label constexpr "$OUT/m" "$OUT/c" | sed 's/^/    /'
+    fi
+  done
+
+  # The fast path compares both counts with 1 + (1 << 32) in one load.
+  local unique_ref='^cg_release	.*\$4294967297\b'
+  if grep -qP "${unique_ref}" "$OUT/master" &&
+     ! grep -qP "${unique_ref}" "$OUT/constexpr"; then
+    echo "cg_release has lost the double-word fast path of _M_release()  << FAIL"
+    status=1
+  fi
+}
+
+run gcc "${MYGCC}"
+run clang "${MYCLANG} ${MYCLANG_NO_WARNINGS}"
+
+exit $status
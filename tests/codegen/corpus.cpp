@@ -0,0 +1,69 @@
+// Hot-path functions whose runtime code should not change when the headers
+// are made constexpr. check_codegen.sh compiles this file at -O2 against both
+// header trees and compares the assembly of each function below.
+//
+// Every function has C linkage so that its name is the same in both builds,
+// and takes its operands by pointer or reference so that nothing is folded.
+
+#include <memory>
+#include <atomic>
+#include <new>
+
+using sp = std::shared_ptr<int>;
+using wp = std::weak_ptr<int>;
+using asp = std::atomic<std::shared_ptr<int>>;
+
+extern "C"
+{
+  void
+  cg_copy(const sp& src, sp* out)
+  { ::new (out) sp(src); }
+
+  void
+  cg_copy_assign(sp& dst, const sp& src)
+  { dst = src; }
+
+  void
+  cg_move_assign(sp& dst, sp& src)
+  { dst = std::move(src); }
+
+  void
+  cg_release(sp* p)
+  { p->~sp(); }
+
+  void
+  cg_weak_release(wp* p)
+  { p->~wp(); }
+
+  void
+  cg_weak_from_shared(const sp& src, wp* out)
+  { ::new (out) wp(src); }
+
+  void
+  cg_weak_lock(const wp& w, sp* out)
+  { ::new (out) sp(w.lock()); }
+
+  long
+  cg_use_count(const sp& p)
+  { return p.use_count(); }
+
+  void
+  cg_make_shared(sp* out)
+  { ::new (out) sp(std::make_shared<int>(42)); }
+
+  void
+  cg_atomic_load(const asp& a, sp* out)
+  { ::new (out) sp(a.load()); }
+
+  void
+  cg_atomic_store(asp& a, sp& desired)
+  { a.store(std::move(desired)); }
+
+  bool
+  cg_atomic_cas(asp& a, sp& expected, sp& desired)
+  { return a.compare_exchange_strong(expected, std::move(desired)); }
+
+  void
+  cg_atomic_exchange(asp& a, sp& desired, sp* out)
+  { ::new (out) sp(a.exchange(std::move(desired))); }
+}
@@ -0,0 +1,60 @@
+#ifndef _CONSTEXPR_COUNTING_ALLOCATOR_
+#define _CONSTEXPR_COUNTING_ALLOCATOR_
+
+// An allocator which counts the allocations and bytes made through it, in
+// an alloc_counts shared by all of its rebound copies. It is usable during
+// constant evaluation, so that tests can check how many allocations each
+// shared_ptr factory makes both at run time and at compile time.
+
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+struct alloc_counts
+{
+  std::size_t allocs = 0;
+  std::size_t deallocs = 0;
+  std::size_t bytes = 0;       // Total bytes allocated.
+  std::size_t live_bytes = 0;  // Bytes allocated and not yet deallocated.
+  std::size_t misaligned = 0;  // Run time only: see allocate().
+};
+
+template <class T>
+struct counting_alloc
+{
+  using value_type = T;
+
+  constexpr counting_alloc(alloc_counts* c) noexcept : c_{ c } { }
+
+  template<class U>
+  constexpr counting_alloc(const counting_alloc<U>& u) noexcept : c_{ u.c_ } { }
+
+  constexpr T* allocate(std::size_t n)
+  {
+    T* p = std::allocator<T>{}.allocate(n);
+    ++c_->allocs;
+    c_->bytes += n * sizeof(T);
+    c_->live_bytes += n * sizeof(T);
+    // An address cannot be inspected during constant evaluation.
+    if !consteval {
+      if (reinterpret_cast<std::uintptr_t>(p) % alignof(T) != 0)
+        ++c_->misaligned;
+    }
+    return p;
+  }
+
+  constexpr void deallocate(T* p, std::size_t n) noexcept
+  {
+    ++c_->deallocs;
+    c_->live_bytes -= n * sizeof(T);
+    std::allocator<T>{}.deallocate(p, n);
+  }
+
+  alloc_counts* c_{};
+};
+
+template<class T, class U>
+constexpr bool operator==(const counting_alloc<T>& t, const counting_alloc<U>& u)
+{ return t.c_ == u.c_; }
+
+#endif // _CONSTEXPR_COUNTING_ALLOCATOR_
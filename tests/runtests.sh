@@ -17,3 +17,12 @@ MYCLANG_NO_WARNINGS="-Wno-unknown-attributes -Wno-ignored-attributes -Wno-deprec
 
 echo -e "\n                        **** << Testing with Clang >> ****\n"
 ${MYCLANG} ${MYCLANG_NO_WARNINGS} ${MYCLANG_FLAGS} shared_ptr_constexpr_tests.cpp && ./a.out
+
+echo -e "\n         **** << Testing with GCC, -D_GLIBCXX_SP_FETCH_ADD_LOCK >> ****\n"
+${MYGCC} ${MYGCC_FLAGS} -D_GLIBCXX_SP_FETCH_ADD_LOCK shared_ptr_constexpr_tests.cpp && ./a.out
+
+echo -e "\n          **** << Testing with GCC, -D_GLIBCXX_SP_INSTRUMENT >> ****\n"
+${MYGCC} ${MYGCC_FLAGS} -D_GLIBCXX_SP_INSTRUMENT shared_ptr_constexpr_tests.cpp -lstdc++exp && ./a.out
+
+echo -e "\n  **** << Testing with GCC, -D_GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD=4096 >> ****\n"
+${MYGCC} ${MYGCC_FLAGS} -D_GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD=4096 shared_ptr_constexpr_tests.cpp && ./a.out
@@ -3,9 +3,26 @@
 #include <atomic>
 #include <iostream>
 #include <tuple>
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+#include <ext/weak_intern_map.h>
+#include <ext/sp_collector.h>
+#include <ext/sp_deferred.h>
+#include <ext/sp_teardown.h>
+#include <ext/sp_flatten.h>
+#include <ext/sp_batch.h>
+#include <ext/sp_pool.h>
+#include <ext/sp_promotable.h>
+#ifdef _GLIBCXX_SP_INSTRUMENT
+#include <ext/sp_instrument.h>
+#include <ext/sp_contention.h>
+#include <ext/sp_alloc_sites.h>
+#endif
 #define VERIFY assert
 #include "testsuite_allocator.h"
 #include "constexpr-pool-allocator.hpp"
+#include "constexpr-counting-allocator.hpp"
 
 template <template <typename...> typename U>
 constexpr bool constexpr_mem_test() {
@@ -480,6 +497,34 @@ constexpr bool owner_before_test()
   return b;
 }
 
+constexpr bool owner_hash_test()
+{
+  struct A { int i; };
+
+  bool b{true};
+  std::shared_ptr<A> p1;
+  std::weak_ptr<A> w1;
+  b = b && p1.owner_hash() == w1.owner_hash() && p1.owner_equal(w1);
+
+  std::shared_ptr<A>   p2(new A());
+  std::shared_ptr<int> p3(p2, &p2->i);
+  std::weak_ptr<A>     w2(p2);
+  std::owner_hash h;
+  std::owner_equal eq;
+  b = b && h(p2) == h(p3) && h(p2) == h(w2);
+  b = b && eq(p2, p3) && eq(p3, w2) && eq(w2, p2) && !eq(p1, p2);
+
+  std::shared_ptr<A> p4(new A());
+  b = b && !eq(p2, p4) && !p4.owner_equal(w2);
+
+  if !consteval
+  {
+    // The address mixer is a bijection, so distinct owners never collide.
+    b = b && h(p2) != h(p4);
+  }
+  return b;
+}
+
 constexpr bool allocate_shared_tests()
 {
   bool b{true};
@@ -817,8 +862,101 @@ namespace esft_tests
     b = good1.use_count() == 3 && good4.use_count() == 2;
     good1->weak_from_this();
     good4->weak_from_this();
+
+    // Each constructor that creates a control block sets up weak_from_this,
+    // and its reference is given up with the block.
+    std::shared_ptr<Good> ps[] = {
+      std::make_shared<Good>(),
+      std::allocate_shared<Good>(std::allocator<Good>()),
+      std::shared_ptr<Good>(new Good),
+      std::shared_ptr<Good>(new Good, std::default_delete<Good>()),
+      std::shared_ptr<Good>(std::make_unique<Good>()),
+    };
+    for (auto& p : ps)
+      {
+        std::weak_ptr<Good> w = p->weak_from_this();
+        b = b && p.use_count() == 1 && w.lock() == p;
+        p.reset();
+        b = b && w.expired();
+      }
     return b;
   }
+
+  // As in the libstdc++ testsuite, 20_util/enable_shared_from_this.
+
+  struct X : std::enable_shared_from_this<X> { int i = 0; };
+  struct Y : X { };
+
+  constexpr bool weak_from_this_test()
+  {
+    bool b = true;
+    // Not owned yet, or by anything after the owner is gone.
+    X* raw = new X;
+    b = b && raw->weak_from_this().expired();
+    std::shared_ptr<X> p(raw);
+    b = b && !raw->weak_from_this().expired();
+    b = b && p->weak_from_this().lock() == p;
+    b = b && std::as_const(*p).weak_from_this().lock() == p;
+    std::weak_ptr<X> w = p->weak_from_this();
+    p.reset();
+    b = b && w.expired();
+
+    // A copy of the object has its own owner.
+    p = std::make_shared<X>();
+    X copy(*p);
+    b = b && copy.weak_from_this().expired();
+    return b;
+  }
+
+  constexpr bool assign()
+  {
+    bool b = true;
+    std::shared_ptr<X> a = std::make_shared<X>();
+    std::shared_ptr<X> c = std::make_shared<X>();
+    c->i = 1;
+    *a = *c; // Does not change the owner.
+    b = b && a->i == 1 && a->shared_from_this() == a;
+    b = b && c->shared_from_this() == c;
+    b = b && a.use_count() == 1 && c.use_count() == 1;
+    return b;
+  }
+
+  constexpr bool derived_and_const()
+  {
+    bool b = true;
+    std::shared_ptr<const Y> p = std::make_shared<Y>();
+    std::shared_ptr<const X> q = p->shared_from_this();
+    b = b && q == p && p.use_count() == 2;
+    std::shared_ptr<X> r(new Y);
+    b = b && r->shared_from_this() == r;
+    std::weak_ptr<const X> w = std::as_const(*r).weak_from_this();
+    b = b && w.lock() == r;
+    return b;
+  }
+
+  struct Z : std::__enable_shared_from_this<Z, __gnu_cxx::_S_single> { };
+
+  constexpr bool non_standard_base()
+  {
+    bool b = true;
+    std::__shared_ptr<Z, __gnu_cxx::_S_single> p(new Z);
+    b = b && p->shared_from_this() == p && p.use_count() == 1;
+    std::__weak_ptr<Z, __gnu_cxx::_S_single> w = p->weak_from_this();
+    b = b && w.lock() == p;
+    w = p->weak_from_this(); // Move assignment.
+    Z z(*p);
+    z = *p;
+    b = b && z.weak_from_this().expired();
+    p.reset();
+    b = b && w.expired();
+    return b;
+  }
+
+  constexpr bool run_all()
+  {
+    return run() && weak_from_this_test() && assign() && derived_and_const()
+      && non_standard_base();
+  }
 }
 
 namespace bad_weak_ptr_tests
@@ -849,6 +987,991 @@ namespace bad_weak_ptr_tests
   }
 }
 
+namespace weak_intern_map_tests
+{
+  struct int_hash
+  {
+    constexpr std::size_t operator()(int i) const noexcept { return i; }
+  };
+
+  struct value
+  {
+    int key;
+    constexpr value(int k) : key(k) { }
+  };
+
+  constexpr bool run()
+  {
+    bool b = true;
+    __gnu_cxx::weak_intern_map<int, value, int_hash, std::equal_to<int>, 4> m;
+    int made = 0;
+    auto make = [&made](int k) {
+      return [&made, k] { ++made; return std::make_shared<value>(k); };
+    };
+
+    b = b && m.empty() && m.find(1) == nullptr;
+
+    std::shared_ptr<value> v1 = m.find_or_insert(1, make(1));
+    std::shared_ptr<value> v1b = m.find_or_insert(1, make(1));
+    b = b && made == 1 && v1 == v1b && v1->key == 1 && m.find(1) == v1;
+
+    // Enough keys to make every shard rehash at least once.
+    std::shared_ptr<value> keep[64];
+    for (int i = 0; i < 64; ++i)
+      keep[i] = m.find_or_insert(100 + i, make(100 + i));
+    b = b && made == 65 && m.size() == 65;
+    for (int i = 0; i < 64; ++i)
+      b = b && m.find(100 + i) == keep[i];
+
+    // Expired entries are replaced, not reused.
+    v1.reset();
+    v1b.reset();
+    b = b && m.find(1) == nullptr;
+    std::shared_ptr<value> v1c = m.find_or_insert(1, make(1));
+    b = b && made == 66 && v1c->key == 1;
+
+    // insert() keeps the live object.
+    auto other = std::make_shared<value>(-1);
+    b = b && m.insert(1, other) == v1c && m.insert(2, other) == other;
+
+    // A null factory result is not stored.
+    b = b && m.find_or_insert(3, [] { return std::shared_ptr<value>(); })
+	       == nullptr && m.find(3) == nullptr;
+
+    b = b && m.erase(2) && !m.erase(2) && m.find(2) == nullptr;
+
+    for (auto& k : keep)
+      k.reset();
+    m.purge();
+    b = b && m.size() == 1;
+    v1c.reset();
+    b = b && m.find(1) == nullptr && m.empty();
+    return b;
+  }
+}
+
+// make_shared allocates with std::allocator, so the global operator new and
+// delete are replaced, to count into the alloc_counts that new_counts points
+// to, on the thread that set it. The size of each allocation is kept in
+// front of it, so that every operator delete can count the bytes it frees.
+thread_local alloc_counts* new_counts = nullptr;
+
+namespace
+{
+  void* counted_new(std::size_t n, std::size_t align)
+  {
+    // The size and the offset of the result take two words of the header.
+    std::size_t head = std::max(align, std::size_t(2 * sizeof(std::size_t)));
+    head = std::max(head, std::size_t(__STDCPP_DEFAULT_NEW_ALIGNMENT__));
+    char* base = static_cast<char*>(
+        std::aligned_alloc(head, (head + n + head - 1) / head * head));
+    if (!base)
+      throw std::bad_alloc();
+    auto* p = reinterpret_cast<std::size_t*>(base + head);
+    p[-1] = n;
+    p[-2] = head;
+    if (alloc_counts* c = new_counts)
+    {
+      ++c->allocs;
+      c->bytes += n;
+      c->live_bytes += n;
+    }
+    return p;
+  }
+
+  void counted_delete(void* v) noexcept
+  {
+    if (!v)
+      return;
+    auto* p = static_cast<std::size_t*>(v);
+    if (alloc_counts* c = new_counts)
+    {
+      ++c->deallocs;
+      c->live_bytes -= p[-1];
+    }
+    std::free(static_cast<char*>(v) - p[-2]);
+  }
+}
+
+void* operator new(std::size_t n)
+{ return counted_new(n, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+
+void* operator new(std::size_t n, std::align_val_t a)
+{ return counted_new(n, static_cast<std::size_t>(a)); }
+
+void operator delete(void* p) noexcept
+{ counted_delete(p); }
+
+void operator delete(void* p, std::size_t) noexcept
+{ counted_delete(p); }
+
+void operator delete(void* p, std::align_val_t) noexcept
+{ counted_delete(p); }
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{ counted_delete(p); }
+
+namespace allocation_count_tests
+{
+  struct alignas(64) over_aligned { int i = 0; };
+
+  constexpr auto lp = __gnu_cxx::__default_lock_policy;
+
+  // At run time, allocate_shared places the object (or array) and the
+  // control block in one allocation. During constant evaluation it goes
+  // through cest_allocate_shared, which allocates them separately.
+  template<class T>
+  constexpr bool one_allocation()
+  {
+    bool b = true;
+    alloc_counts c;
+    {
+      auto p = std::allocate_shared<T>(counting_alloc<T>{&c});
+      using cb = std::_Sp_counted_ptr_inplace<T, counting_alloc<T>, lp>;
+      if consteval {
+        b = b && c.allocs == 2;
+      } else {
+        b = b && c.allocs == 1 && c.bytes == sizeof(cb) && c.misaligned == 0;
+        b = b && reinterpret_cast<std::uintptr_t>(p.get()) % alignof(T) == 0;
+      }
+    }
+    return b && c.deallocs == c.allocs && c.live_bytes == 0;
+  }
+
+  template<class T>
+  constexpr bool one_array_allocation(std::size_t n)
+  {
+    bool b = true;
+    alloc_counts c;
+    {
+      auto p = std::allocate_shared<T[]>(counting_alloc<T>{&c}, n);
+      using cb = std::_Sp_counted_array<counting_alloc<T>, lp>;
+      if consteval {
+        b = b && c.allocs == 2;
+      } else {
+        b = b && c.allocs == 1 && c.misaligned == 0;
+        b = b && c.bytes == (n + cb::_S_tail()) * sizeof(T);
+        b = b && reinterpret_cast<std::uintptr_t>(p.get()) % alignof(T) == 0;
+      }
+    }
+    return b && c.deallocs == c.allocs && c.live_bytes == 0;
+  }
+
+  // make_shared has a consteval branch of its own for each overload, and
+  // uses std::allocator at run time, so is counted with new_counts.
+  template<class T>
+  bool make_shared_one_allocation()
+  {
+    bool b = true;
+    alloc_counts c;
+    new_counts = &c;
+    {
+      auto p = std::make_shared<T>();
+      using cb = std::_Sp_counted_ptr_inplace<T, std::allocator<void>, lp>;
+      b = b && c.allocs == 1 && c.bytes == sizeof(cb);
+      b = b && reinterpret_cast<std::uintptr_t>(p.get()) % alignof(T) == 0;
+    }
+    new_counts = nullptr;
+    return b && c.deallocs == c.allocs && c.live_bytes == 0;
+  }
+
+  template<class T, std::size_t N = 0>
+  bool make_shared_one_array_allocation(std::size_t n = N)
+  {
+    bool b = true;
+    alloc_counts c;
+    new_counts = &c;
+    {
+      std::shared_ptr<T[]> p;
+      if constexpr (N != 0)
+        p = std::make_shared<T[N]>();
+      else
+        p = std::make_shared<T[]>(n);
+      using cb = std::_Sp_counted_array<std::allocator<T>, lp>;
+      b = b && c.allocs == 1;
+      b = b && c.bytes == (n + cb::_S_tail()) * sizeof(T);
+      b = b && reinterpret_cast<std::uintptr_t>(p.get()) % alignof(T) == 0;
+    }
+    new_counts = nullptr;
+    return b && c.deallocs == c.allocs && c.live_bytes == 0;
+  }
+
+  constexpr bool run()
+  {
+    bool b = true;
+
+    b = b && one_allocation<int>();
+    b = b && one_allocation<over_aligned>();
+    b = b && one_array_allocation<int>(1);
+    b = b && one_array_allocation<int>(100);
+    b = b && one_array_allocation<over_aligned>(3);
+
+    if !consteval {
+      b = b && make_shared_one_allocation<int>();
+      b = b && make_shared_one_allocation<over_aligned>();
+      b = b && make_shared_one_array_allocation<int>(1);
+      b = b && make_shared_one_array_allocation<int>(100);
+      b = b && make_shared_one_array_allocation<over_aligned>(3);
+      b = b && make_shared_one_array_allocation<int, 100>();
+    }
+
+    // out_ptr allocates just the control block, before the call.
+    {
+      alloc_counts c;
+      {
+        using del = std::default_delete<int>;
+        using cb = std::_Sp_counted_deleter<int*, del, counting_alloc<int>, lp>;
+        std::shared_ptr<int> sp;
+        counting_alloc<int> a{&c};
+        auto f = [&](int** pp) {
+          b = b && c.allocs == 1 && c.bytes == sizeof(cb);
+          *pp = new int{42};
+        };
+        f(std::out_ptr(sp, del{}, a));
+        b = b && *sp == 42 && c.allocs == 1;
+      }
+      b = b && c.deallocs == 1 && c.live_bytes == 0;
+    }
+
+    // ...or nothing at all, with a reserved block, which is handed back
+    // whenever the call produces no pointer.
+    {
+      alloc_counts c;
+      {
+        using del = std::default_delete<int>;
+        __gnu_cxx::out_ptr_block<int, del, counting_alloc<int>> blk{&c};
+        std::shared_ptr<int> sp;
+        blk.reserve();
+        b = b && c.allocs == 1;
+        for (int i = 0; i < 3; ++i)
+          [&](int** pp) { *pp = i == 2 ? new int{i} : nullptr; }
+            (std::out_ptr(sp, del{}, blk));
+        b = b && *sp == 2 && c.allocs == 1 && !blk.has_block();
+      }
+      b = b && c.deallocs == 1 && c.live_bytes == 0;
+    }
+
+    return b;
+  }
+}
+
+namespace collector_tests
+{
+  int destroyed = 0;
+
+  struct node : std::enable_shared_from_this<node>
+  {
+    std::shared_ptr<node> next;
+    std::shared_ptr<node> other;
+    std::shared_ptr<int> data = std::make_shared<int>(1);
+
+    ~node() { ++destroyed; }
+
+    template<typename V>
+      void sp_visit(V& v) { v(next); v(other); v(data); }
+  };
+
+  bool run()
+  {
+    using __gnu_cxx::make_shared_collectable;
+    using __gnu_cxx::sp_collector;
+    bool b = true;
+
+    // A cycle of two, and an object that the cycle refers to but which is
+    // also owned from outside.
+    std::shared_ptr<node> keep = make_shared_collectable<node>();
+    {
+      auto n1 = make_shared_collectable<node>();
+      auto n2 = make_shared_collectable<node>();
+      n1->next = n2;
+      n2->next = n1;
+      n1->other = keep;
+      b = b && n1->shared_from_this() == n1;
+    }
+    b = b && sp_collector::tracked() == 3 && destroyed == 0;
+    b = b && sp_collector::collect() == 2;
+    b = b && destroyed == 2 && sp_collector::tracked() == 1;
+    b = b && keep.use_count() == 1;
+
+    // Reachable from a live object: not collected.
+    keep->next = make_shared_collectable<node>();
+    keep->next->next = keep->next;
+    b = b && sp_collector::collect() == 0 && destroyed == 2;
+
+    // Once unreachable, found by a slice.
+    keep->next.reset();
+    b = b && sp_collector::tracked() == 2;
+    std::size_t freed = 0;
+    for (int i = 0; i < 2; ++i)
+      freed += sp_collector::collect_slice(1);
+    b = b && freed == 1 && destroyed == 3;
+
+    keep.reset();
+    b = b && sp_collector::tracked() == 0 && destroyed == 4;
+    return b;
+  }
+}
+
+namespace deferred_tests
+{
+  std::atomic<int> destroyed{0};
+
+  struct big : std::enable_shared_from_this<big>
+  {
+    int data[1024] = {};
+    ~big() { ++destroyed; }
+  };
+
+  bool run()
+  {
+    using __gnu_cxx::make_shared_deferred;
+    using __gnu_cxx::sp_deferred_queue;
+    bool b = true;
+    auto before = sp_deferred_queue::stats();
+
+    // Released, but only destroyed by drain().
+    std::shared_ptr<big> p = make_shared_deferred<big>();
+    std::weak_ptr<big> w = p->weak_from_this();
+    p.reset();
+    b = b && w.expired() && destroyed == 0;
+    auto s = sp_deferred_queue::stats();
+    b = b && s.pending == 1 && s.enqueued == before.enqueued + 1;
+    b = b && sp_deferred_queue::drain() == 1 && destroyed == 1;
+    s = sp_deferred_queue::stats();
+    b = b && s.pending == 0 && s.reclaimed == before.reclaimed + 1;
+    w.reset(); // Frees the control block.
+
+    // Drained in slices, from several threads' releases.
+    std::shared_ptr<big> ps[8];
+    for (auto& q : ps)
+      q = make_shared_deferred<big>();
+    std::thread t([&ps] { for (int i = 0; i < 4; ++i) ps[i].reset(); });
+    for (int i = 4; i < 8; ++i)
+      ps[i].reset();
+    t.join();
+    b = b && sp_deferred_queue::stats().pending == 8;
+    b = b && sp_deferred_queue::drain(3) == 3 && destroyed == 4;
+    b = b && sp_deferred_queue::drain() == 5 && destroyed == 9;
+
+    // By the reclaimer thread.
+    sp_deferred_queue::start_reclaimer(std::chrono::microseconds(100));
+    p = make_shared_deferred<big>();
+    p.reset();
+    while (destroyed != 10)
+      std::this_thread::yield();
+    sp_deferred_queue::stop_reclaimer();
+    b = b && sp_deferred_queue::stats().pending == 0;
+    return b;
+  }
+}
+
+namespace teardown_tests
+{
+  struct chain
+  {
+    std::shared_ptr<chain> next;
+    int* count;
+
+    constexpr chain(std::shared_ptr<chain> n, int* c) : next(std::move(n)), count(c) { }
+    constexpr ~chain() { __gnu_cxx::sp_teardown(*this); ++*count; }
+
+    template<typename V>
+      constexpr void sp_visit(V& v) { v(next); }
+  };
+
+  struct tree
+  {
+    std::shared_ptr<tree> left, right;
+    int* count;
+
+    constexpr ~tree() { ++*count; }
+
+    template<typename V>
+      constexpr void sp_visit(V& v) { v(left); v(right); }
+  };
+
+  constexpr bool run()
+  {
+    bool b = true;
+    // Deeper than the recursion limits of the stack and of the evaluator.
+    int n = std::is_constant_evaluated() ? 2000 : 1000000;
+
+    int count = 0;
+    {
+      std::shared_ptr<chain> head;
+      for (int i = 0; i < n; ++i)
+        head = std::make_shared<chain>(std::move(head), &count);
+    }
+    b = b && count == n;
+
+    // Through the deleter, and with an object that a weak_ptr refers to
+    // near the end, which is destroyed recursively.
+    count = 0;
+    {
+      using deleter = __gnu_cxx::sp_iterative_delete<tree>;
+      std::weak_ptr<tree> w;
+      std::shared_ptr<tree> root(new tree{nullptr, nullptr, &count}, deleter());
+      tree* t = root.get();
+      for (int i = 0; i < n; ++i)
+        {
+          t->right = std::make_shared<tree>(nullptr, nullptr, &count);
+          t->left = std::make_shared<tree>(nullptr, nullptr, &count);
+          if (i == n - 3)
+            w = t->right;
+          t = t->right.get();
+        }
+    }
+    b = b && count == 2 * n + 1;
+    return b;
+  }
+}
+
+namespace flatten_tests
+{
+  struct node
+  {
+    int value;
+    std::shared_ptr<node> left, right;
+
+    template<typename V>
+      constexpr void sp_visit(V& v) { v(left); v(right); }
+  };
+
+  // Two paths to one leaf.
+  constexpr std::shared_ptr<node> make_diamond()
+  {
+    auto leaf = std::make_shared<node>(3);
+    auto a = std::make_shared<node>(1, leaf);
+    auto b = std::make_shared<node>(2, nullptr, leaf);
+    return std::make_shared<node>(0, a, b);
+  }
+
+  constexpr int value_of(const node& n) { return n.value; }
+
+  constinit const auto table
+    = __gnu_cxx::sp_flatten<make_diamond, value_of>();
+
+  template<typename Graph>
+    constexpr bool check(const Graph& g)
+    {
+      bool b = g.nodes.size() == 4 && g.links.size() == 8;
+      auto v = g.view();
+      auto root = v.root();
+      b = b && root && *root == 0 && root.size() == 2;
+      b = b && *root[0] == 1 && *root[1] == 2;
+      b = b && root[0][0] == root[1][1] && *root[0][0] == 3;
+      b = b && !root[0][1] && !root[1][0];
+      b = b && root[0][0].size() == 2 && !root[0][0][0];
+      return b;
+    }
+
+  constexpr std::shared_ptr<node> make_null() { return nullptr; }
+
+  constexpr bool run()
+  {
+    bool b = check(__gnu_cxx::sp_flatten<make_diamond, value_of>());
+    if (!std::is_constant_evaluated())
+      b = b && check(table);
+    constexpr auto empty = __gnu_cxx::sp_flatten<make_null, value_of>();
+    b = b && empty.view().size() == 0 && !empty.view().root();
+    return b;
+  }
+}
+
+namespace layout_tests
+{
+  constexpr auto lp = __gnu_cxx::_S_atomic;
+
+#if defined __x86_64__ && defined __LP64__ && !defined _GLIBCXX_SP_INSTRUMENT
+  // A vtable pointer and the two counts.
+  static_assert(sizeof(std::_Sp_counted_base<lp>) == 16);
+  static_assert(sizeof(std::_Sp_counted_ptr<int*, lp>) == 24);
+
+  // Empty deleters and allocators take no space.
+  using del = std::default_delete<int>;
+  static_assert(sizeof(std::_Sp_counted_deleter<int*, del,
+                                               std::allocator<void>, lp>) == 24);
+  static_assert(sizeof(std::_Sp_counted_deleter<int*, void(*)(int*),
+                                               std::allocator<void>, lp>) == 32);
+
+  static_assert(sizeof(std::_Sp_counted_ptr_inplace<char, std::allocator<void>,
+                                                     lp>) == 24);
+  static_assert(sizeof(std::_Sp_counted_ptr_inplace<int, std::allocator<void>,
+                                                     lp>) == 24);
+  static_assert(sizeof(std::_Sp_counted_ptr_inplace<long, std::allocator<void>,
+                                                     lp>) == 24);
+
+  // The overwrite flag shares the word of the count, and the start of the
+  // allocation is found from the address of the block unless a non-standard
+  // allocator might leave it less aligned than the block.
+  static_assert(sizeof(std::_Sp_counted_array_base<std::allocator<int>>) == 8);
+  static_assert(sizeof(std::_Sp_counted_array<std::allocator<char>, lp>) == 24);
+  static_assert(sizeof(std::_Sp_counted_array<std::allocator<int>, lp>) == 24);
+  static_assert(sizeof(std::_Sp_counted_array<std::allocator<long>, lp>) == 24);
+  static_assert(sizeof(std::_Sp_counted_array<counting_alloc<long>, lp>) == 24);
+  static_assert(sizeof(std::_Sp_counted_array<counting_alloc<int>, lp>) == 32);
+#endif
+
+  template<class T>
+  bool arrays(std::size_t n)
+  {
+    bool b = true;
+    {
+      auto p = std::make_shared<T[]>(n, T(7));
+      for (std::size_t i = 0; i < n; ++i)
+        b = b && p[i] == T(7);
+      std::weak_ptr<T[]> w = p;
+      p.reset();
+      b = b && w.expired();
+    }
+    {
+      auto p = std::make_shared_for_overwrite<T[]>(n);
+      for (std::size_t i = 0; i < n; ++i)
+        p[i] = T(i);
+      b = b && (n == 0 || p[n - 1] == T(n - 1));
+    }
+    return b;
+  }
+
+  bool run()
+  {
+    bool b = true;
+    for (std::size_t n = 0; n < 20; ++n)
+      b = b && arrays<char>(n) && arrays<short>(n) && arrays<int>(n)
+            && arrays<long>(n) && arrays<double>(n);
+    return b;
+  }
+}
+
+namespace batch_tests
+{
+  int alive = 0;
+  int made = 0;
+  int fail_at = -1; // The number of the construction that throws.
+
+  struct node : std::enable_shared_from_this<node>
+  {
+    int value;
+    node(int a, int b) : value(a + b)
+    {
+      if (value < 0 || made++ == fail_at)
+        throw value;
+      ++alive;
+    }
+    ~node() { --alive; }
+  };
+
+  bool run()
+  {
+    using __gnu_cxx::make_shared_batch;
+    bool b = true;
+
+    auto v = make_shared_batch<node>(1000, 1, 2);
+    b = b && v.size() == 1000 && alive == 1000;
+    for (auto& p : v)
+      b = b && p->value == 3 && p.use_count() == 1
+            && p->weak_from_this().lock() == p;
+
+    // Each object goes on its own, and the memory with the last one.
+    std::weak_ptr<node> w = v[10];
+    std::vector<std::shared_ptr<node>> keep{v[999], v[0]};
+    v.clear();
+    b = b && alive == 2 && w.expired() && keep[0]->value == 3;
+    keep.clear();
+    b = b && alive == 0;
+
+    // A constructor that throws undoes the ones before it.
+    try
+      {
+        (void) make_shared_batch<node>(10, 0, -1);
+        b = false;
+      }
+    catch (int)
+      {
+      }
+    b = b && alive == 0;
+
+    // ...also once some have been made, and handed to shared_ptrs.
+    made = 0;
+    fail_at = 4;
+    try
+      {
+        (void) make_shared_batch<node>(10, 1, 2);
+        b = false;
+      }
+    catch (int)
+      {
+      }
+    b = b && made == 5 && alive == 0;
+    fail_at = -1;
+
+    b = b && make_shared_batch<node>(0, 1, 2).empty();
+    auto c = make_shared_batch<const node>(3, 2, 2);
+    b = b && c[2]->value == 4;
+    return b;
+  }
+}
+
+namespace pool_tests
+{
+  std::atomic<int> made{0};
+  std::atomic<int> destroyed{0};
+
+  struct buffer
+  {
+    std::vector<int> data;
+    buffer() { data.reserve(1000); ++made; }
+    ~buffer() { ++destroyed; }
+    void reset() noexcept { data.clear(); }
+  };
+
+  struct self : std::enable_shared_from_this<self>
+  {
+    int uses = 0;
+    void reset() noexcept { }
+  };
+
+  bool run()
+  {
+    using pool = __gnu_cxx::sp_pool<buffer>;
+    bool b = true;
+
+    // Reset when the last shared_ptr goes, reused once no weak_ptr is left.
+    auto p = __gnu_cxx::make_shared_pooled<buffer>();
+    p->data.push_back(1);
+    const int* storage = p->data.data();
+    std::weak_ptr<buffer> w = p;
+    p.reset();
+    b = b && w.expired() && pool::pooled() == 0;
+    w.reset();
+    b = b && pool::pooled() == 1 && made == 1 && destroyed == 0;
+    p = pool::acquire();
+    b = b && p->data.empty() && p->data.data() == storage && made == 1;
+    auto s = pool::stats();
+    b = b && s.hits == 1 && s.misses == 1 && s.recycled == 1;
+
+    // The free list keeps no more than its capacity.
+    pool::set_capacity(2);
+    {
+      std::vector<std::shared_ptr<buffer>> v;
+      for (int i = 0; i < 4; ++i)
+        v.push_back(pool::acquire());
+    }
+    b = b && pool::pooled() == 2 && destroyed == 2;
+    b = b && pool::stats().discarded == 2;
+
+    // Another thread's list is its own, and goes with it.
+    std::thread([] { auto x = pool::acquire(); }).join();
+    b = b && pool::pooled() == 2 && destroyed == 3;
+
+    pool::trim();
+    b = b && pool::pooled() == 0 && destroyed == 5;
+    p.reset();
+    b = b && pool::pooled() == 1;
+
+    // The weak_ptr in an enable_shared_from_this base does not keep the
+    // object out of the free list, and refers to each new owner.
+    using self_pool = __gnu_cxx::sp_pool<self>;
+    auto q = self_pool::acquire();
+    ++q->uses;
+    std::weak_ptr<self> wq = q->weak_from_this();
+    b = b && q->shared_from_this() == q;
+    q.reset();
+    b = b && wq.expired() && self_pool::pooled() == 0;
+    wq.reset();
+    b = b && self_pool::pooled() == 1;
+    q = self_pool::acquire();
+    b = b && q->uses == 1 && self_pool::stats().hits == 1;
+    b = b && q->shared_from_this() == q;
+    b = b && q.use_count() == 1;
+    q.reset();
+    b = b && self_pool::pooled() == 1;
+    self_pool::trim();
+    return b;
+  }
+}
+
+namespace promotable_tests
+{
+  struct base
+  {
+    int* destroyed;
+    constexpr virtual ~base() { ++*destroyed; }
+  };
+
+  struct derived : base, std::enable_shared_from_this<derived>
+  {
+    int value;
+    constexpr derived(int* d, int v) : base{d}, value(v) { }
+  };
+
+  constexpr bool run()
+  {
+    using __gnu_cxx::make_unique_promotable;
+    bool b = true;
+    int destroyed = 0;
+
+    // Not shared: destroyed and freed by the unique_ptr.
+    {
+      auto u = make_unique_promotable<derived>(&destroyed, 1);
+      b = b && u->value == 1;
+    }
+    b = b && destroyed == 1;
+
+    // Shared: the control block is the one made with the object.
+    {
+      auto u = make_unique_promotable<derived>(&destroyed, 2);
+      auto* storage = u.get_deleter()._M_storage;
+      std::shared_ptr<base> p = std::move(u);
+      b = b && !u && p.use_count() == 1;
+      b = b && std::_Sp_block_access::_S_block(p) == &storage->_M_block;
+      // The deleter goes with it.
+      using del = std::_Sp_promotable_delete<derived>;
+      auto* d = std::get_deleter<del>(p);
+      b = b && d != nullptr && d->_M_storage == storage;
+      std::weak_ptr<base> w = p;
+      auto q = std::static_pointer_cast<derived>(p)->shared_from_this();
+      b = b && q->value == 2 && p.use_count() == 2;
+      p.reset();
+      q.reset();
+      b = b && w.expired() && destroyed == 2;
+    }
+
+    // An empty one makes an empty shared_ptr.
+    __gnu_cxx::unique_promotable_ptr<derived> e;
+    std::shared_ptr<derived> n = std::move(e);
+    b = b && !n && n.use_count() == 0;
+    return b;
+  }
+}
+
+namespace zeroed_array_tests
+{
+  constexpr auto lp = __gnu_cxx::__default_lock_policy;
+
+  // With _GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD, large arrays come from calloc.
+  template<class T, class P>
+  bool from_calloc([[maybe_unused]] const P& p)
+  {
+#ifdef _GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD
+    using cb = std::_Sp_counted_array<std::__sp_zeroed_allocator<T>, lp>;
+    return dynamic_cast<cb*>(std::_Sp_block_access::_S_block(p)) != nullptr;
+#else
+    return false;
+#endif
+  }
+
+  template<class T>
+  bool zeroed(std::size_t n)
+  {
+    bool b = true;
+    auto p = std::make_shared<T[]>(n);
+    for (std::size_t i = 0; i < n; i += 1021)
+      b = b && p[i] == T();
+    b = b && (n == 0 || p[n - 1] == T());
+    std::weak_ptr<T[]> w = p;
+    p.reset();
+    return b && w.expired();
+  }
+
+  struct S { int i; };
+
+  // Value-initialization at run time.
+  bool run()
+  {
+    bool b = true;
+    constexpr std::size_t big = std::size_t(1) << 20;
+    b = b && zeroed<int>(100) && zeroed<int>(big);
+    b = b && zeroed<char>(big + 1) && zeroed<double>(big);
+    b = b && zeroed<int*>(big);
+
+    auto small = std::make_shared<int[]>(8);
+    auto large = std::make_shared<long[]>(big);
+    auto fixed = std::make_shared<int[big]>();
+    auto members = std::make_shared<int S::*[]>(big);
+    b = b && fixed[big - 1] == 0 && members[0] == nullptr;
+    b = b && !from_calloc<int>(small) && !from_calloc<int S::*>(members);
+#ifdef _GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD
+    b = b && from_calloc<long>(large) && from_calloc<int>(fixed);
+
+    // The threshold is in bytes, whether or not the element size divides it.
+    constexpr std::size_t t = _GLIBCXX_SP_ZEROED_ARRAY_THRESHOLD;
+    using row = int[3];
+    auto under = std::make_shared<row[]>((t - 1) / sizeof(row));
+    auto over = std::make_shared<row[]>((t + sizeof(row) - 1) / sizeof(row));
+    b = b && !from_calloc<int>(under) && from_calloc<int>(over);
+    static_assert(std::__sp_zeroed_array<row[]>(std::size_t(-1)));
+#endif
+    return b;
+  }
+}
+
+namespace weak_lock_race_tests
+{
+  std::atomic<int> destroyed{0};
+
+  struct obj
+  {
+    ~obj() { ++destroyed; }
+  };
+
+  // The last shared_ptr goes while other threads lock and release weak_ptrs
+  // to the object. Most interesting with _GLIBCXX_SP_FETCH_ADD_LOCK, where
+  // a lock can revive a use count that has reached zero but not yet been
+  // expired, and run with -fsanitize=address for use-after-free.
+  bool run()
+  {
+    bool b = true;
+    constexpr int rounds = 2000, lockers = 3;
+    for (int r = 0; r < rounds; ++r)
+      {
+        auto p = std::make_shared<obj>();
+        std::atomic<bool> go{false}, bad{false};
+        std::vector<std::thread> ts;
+        for (int t = 0; t < lockers; ++t)
+          ts.emplace_back([w = std::weak_ptr<obj>(p), &go, &bad] () mutable {
+            while (!go)
+              ;
+            for (int i = 0; i < 100; ++i)
+              {
+                // Once expired, the object cannot come back.
+                bool expired = w.expired();
+                if (std::shared_ptr<obj> q = w.lock(); q && expired)
+                  bad = true;
+              }
+            w.reset(); // May be the last reference to the control block.
+          });
+        go = true;
+        p.reset();
+        for (auto& t : ts)
+          t.join();
+        b = b && !bad && destroyed == r + 1;
+      }
+    return b;
+  }
+}
+
+#ifdef _GLIBCXX_SP_INSTRUMENT
+namespace instrument_tests
+{
+  struct tracked { int i = 0; };
+
+  struct thrower { thrower() { throw 1; } };
+
+  constexpr auto lp = __gnu_cxx::__default_lock_policy;
+
+  int creates = 0, destroys = 0;
+
+  void count_hook(__gnu_cxx::sp_event e, const void*, const std::type_info*,
+                  std::size_t) noexcept
+  {
+    creates += e == __gnu_cxx::sp_event::_S_create;
+    destroys += e == __gnu_cxx::sp_event::_S_destroy;
+  }
+
+  constexpr bool run()
+  {
+    bool b = true;
+    std::shared_ptr<tracked> p = std::make_shared<tracked>();
+    if consteval {
+      // The hooks are inert during constant evaluation.
+      std::weak_ptr<tracked> w = p;
+      b = b && w.lock() == p;
+    } else {
+      using __gnu_cxx::sp_counters;
+      p.reset(); // Created before the hook is installed, so not counted.
+      auto old = __gnu_cxx::get_sp_hook();
+      sp_counters::install();
+      {
+        auto p1 = std::make_shared<tracked>();
+        auto p2 = p1;
+        std::weak_ptr<tracked> w = p1;
+        auto p3 = w.lock();
+        using cb = std::_Sp_counted_ptr_inplace<tracked, std::allocator<void>,
+                                                lp>;
+        auto s = sp_counters::get(typeid(tracked));
+        b = b && s.created == 1 && s.live == 1 && s.bytes == sizeof(cb);
+        b = b && s.add_refs == 2 && s.weak_add_refs == 1 && s.releases == 0;
+      }
+      auto s = sp_counters::get(typeid(tracked));
+      b = b && s.live == 0 && s.live_bytes == 0 && s.releases == 3;
+      b = b && s.disposed == 1 && s.weak_releases >= 1;
+      {
+        std::shared_ptr<tracked> q(new tracked);
+      }
+      s = sp_counters::get(typeid(tracked));
+      b = b && s.created == 2 && s.live == 0 && s.disposed == 2;
+      {
+        // No weak references, so the last release takes the fast path
+        // where there is one, and must report the same events.
+        auto before = sp_counters::get(typeid(tracked));
+        std::make_shared<tracked>().reset();
+        s = sp_counters::get(typeid(tracked));
+        b = b && s.disposed == before.disposed + 1;
+        b = b && s.weak_releases == before.weak_releases + 1;
+        b = b && s.live == 0;
+      }
+      __gnu_cxx::set_sp_hook(old);
+
+      // A block whose object fails to construct is neither created nor
+      // destroyed.
+      __gnu_cxx::set_sp_hook(&count_hook);
+      try
+        {
+          (void) std::make_shared<thrower>();
+          b = false;
+        }
+      catch (int)
+        {
+        }
+      __gnu_cxx::set_sp_hook(old);
+      b = b && creates == 0 && destroys == 0;
+
+      // Sampling every event, each copy gives an add_ref and a release.
+      {
+        using __gnu_cxx::sp_contention_profiler;
+        auto p1 = std::make_shared<tracked>();
+        sp_contention_profiler::install(1);
+        for (int i = 0; i < 10; ++i)
+          auto p2 = p1;
+        sp_contention_profiler::uninstall();
+        auto hot = sp_contention_profiler::top(1);
+        b = b && hot.size() == 1 && hot[0].samples == 20;
+        b = b && hot[0].threads == 1 && *hot[0].type == typeid(tracked);
+        sp_contention_profiler::clear();
+        b = b && sp_contention_profiler::top().empty();
+      }
+      b = b && __gnu_cxx::get_sp_hook() == old;
+
+      // Three blocks created from one call stack, one of them from another.
+      {
+        using __gnu_cxx::sp_alloc_sites;
+        using cb = std::_Sp_counted_ptr_inplace<tracked, std::allocator<void>,
+                                                lp>;
+        sp_alloc_sites::install();
+        std::shared_ptr<tracked> ps[3];
+        for (auto& p1 : ps)
+          p1 = std::make_shared<tracked>();
+        auto p2 = std::make_shared<tracked>();
+        auto sites = sp_alloc_sites::live();
+        b = b && sites.size() == 2 && !sites[0].trace.empty();
+        b = b && sites[0].blocks == 3 && sites[0].bytes == 3 * sizeof(cb);
+        b = b && sites[1].blocks == 1 && sites[1].bytes == sizeof(cb);
+        for (auto& p1 : ps)
+          p1.reset();
+        sites = sp_alloc_sites::live();
+        b = b && sites.size() == 1 && sites[0].blocks == 1;
+        p2.reset();
+        b = b && sp_alloc_sites::live().empty();
+        // Only once nothing is tracked, as destruction goes unseen after.
+        sp_alloc_sites::uninstall();
+      }
+    }
+    return b;
+  }
+}
+#endif
+
 void memory_tests()
 {
   static_assert(constexpr_mem_test<std::unique_ptr>(),
@@ -892,6 +2015,9 @@ void memory_tests()
   assert(owner_before_test());
   static_assert(owner_before_test());
 
+  assert(owner_hash_test());
+  static_assert(owner_hash_test());
+
   assert(allocate_shared_tests());
   static_assert(allocate_shared_tests());
 
@@ -904,11 +2030,45 @@ void memory_tests()
   assert(weak_ptr_tests::run());
   static_assert(weak_ptr_tests::run());
 
-  assert(esft_tests::run());
-  static_assert(esft_tests::run());
+  assert(esft_tests::run_all());
+  static_assert(esft_tests::run_all());
 
   assert(bad_weak_ptr_tests::run());
   static_assert(bad_weak_ptr_tests::run());
+
+  assert(weak_intern_map_tests::run());
+  static_assert(weak_intern_map_tests::run());
+
+  assert(allocation_count_tests::run());
+  static_assert(allocation_count_tests::run());
+
+  assert(collector_tests::run());
+
+  assert(deferred_tests::run());
+
+  assert(teardown_tests::run());
+  static_assert(teardown_tests::run());
+
+  assert(flatten_tests::run());
+  static_assert(flatten_tests::run());
+
+  assert(layout_tests::run());
+
+  assert(batch_tests::run());
+
+  assert(pool_tests::run());
+
+  assert(promotable_tests::run());
+  static_assert(promotable_tests::run());
+
+  assert(zeroed_array_tests::run());
+
+  assert(weak_lock_race_tests::run());
+
+#ifdef _GLIBCXX_SP_INSTRUMENT
+  assert(instrument_tests::run());
+  static_assert(instrument_tests::run());
+#endif
 }
 
 constexpr
@@ -923,7 +2083,7 @@ bool atomic_tests_basic()
 
   ai0.store(43);
   int i = ai0.load();
-  ai0.wait(44); // change to 43 for non-termination
+  ai0.wait(44); // 43 would not be a constant expression, as it blocks
   ai0.notify_one();
   ai0.notify_all();
   b = b && i == 43;
@@ -972,7 +2132,7 @@ bool atomic_smart_ptr_tests()
   b = b && 10 == asp3.load()[0];
 
   asp2.wait(sp0);
-  //asp2.wait(sp2); // non-termination
+  //asp2.wait(sp2); // Not a constant expression, as it blocks.
   asp2.notify_one();
   asp2.notify_all();
 
@@ -1014,6 +2174,25 @@ bool atomic_smart_ptr_tests()
     b = b && sptr3 == nullptr;
   }
 
+  // atomic<weak_ptr>::load_locked() and lock()
+  {
+    std::atomic<std::weak_ptr<int>> wptr{};
+    b = b && wptr.load_locked() == nullptr;
+
+    {
+      std::shared_ptr<int> sptr = std::make_shared<int>(42);
+      wptr.store(sptr);
+      std::shared_ptr<int> sptr2 = wptr.load_locked();
+      b = b && sptr2 == sptr && sptr.use_count() == 2;
+      std::shared_ptr<int> sptr3 = wptr.lock(std::memory_order_acquire);
+      b = b && *sptr3 == 42 && sptr.use_count() == 3;
+      b = b && !wptr.load().owner_before(sptr) && !sptr.owner_before(wptr.load());
+    }
+
+    b = b && wptr.load_locked() == nullptr && wptr.lock() == nullptr;
+    b = b && wptr.load().expired();
+  }
+
   return b;
 }
 
@@ -1070,6 +2249,25 @@ bool inout_tests_typed_conversion()
     b = b && 42 == *sp;
   }
 
+  // shared_ptr; out_ptr with a reusable control block; int**
+  {
+    __gnu_cxx::out_ptr_block<int, decltype(del)> blk;
+    std::shared_ptr<int> sp;
+    auto f = [&](int **pp) { b = b && nullptr == *pp; *pp = new int{42}; };
+    auto g = [&](int **pp) { b = b && nullptr == *pp; };
+    blk.reserve();
+    b = b && blk.has_block();
+    f(std::out_ptr(sp, del, blk));
+    b = b && 42 == *sp && !blk.has_block();
+    g(std::out_ptr(sp, del, blk)); // sp's block is reused, then handed back
+    b = b && nullptr == sp && blk.has_block();
+    f(std::out_ptr(sp, del, blk));
+    b = b && 42 == *sp && !blk.has_block();
+    std::shared_ptr<int> sp2 = sp; // now shared, so it cannot be reused
+    f(std::out_ptr(sp, del, blk));
+    b = b && 42 == *sp && 42 == *sp2 && sp != sp2 && !blk.has_block();
+  }
+
   // n.b. shared_ptr cannot be used with inout_ptr
 
   // unique_ptr; inout_ptr; int**